@@ -0,0 +1,478 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app.h"
+#include "chip8.h"
+#include "instruction_tables.h"
+#include "aot.h"
+#include "platform.h"
+
+// Handler name for the generated call, by the function decode_opcode resolves to
+typedef struct aot_handler
+{
+    instruction_func_t handler;
+    const char *name;
+} aot_handler_t;
+
+#define HANDLER(name) {name, #name}
+#define HANDLER_VARIANTS(name) HANDLER(name##_CHIP8), HANDLER(name##_SUPERCHIP), HANDLER(name##_X0CHIP)
+
+static const aot_handler_t handler_names[] = {
+    HANDLER(instr_00E0), HANDLER(instr_00EE), HANDLER(instr_00CN), HANDLER(instr_00DN), HANDLER(instr_00FB),
+    HANDLER(instr_00FC), HANDLER(instr_00FD), HANDLER(instr_00FE), HANDLER(instr_00FF),
+    HANDLER(instr_1NNN), HANDLER(instr_2NNN), HANDLER(instr_3XNN), HANDLER(instr_4XNN), HANDLER(instr_5XY0),
+    HANDLER(instr_6XNN), HANDLER(instr_7XNN),
+    HANDLER(instr_8XY0), HANDLER_VARIANTS(instr_8XY1), HANDLER_VARIANTS(instr_8XY2), HANDLER_VARIANTS(instr_8XY3),
+    HANDLER(instr_8XY4), HANDLER(instr_8XY5), HANDLER_VARIANTS(instr_8XY6), HANDLER(instr_8XY7),
+    HANDLER_VARIANTS(instr_8XYE),
+    HANDLER(instr_9XY0), HANDLER(instr_ANNN), HANDLER(instr_BNNN), HANDLER(instr_CXNN), HANDLER_VARIANTS(instr_DXYN),
+    HANDLER(instr_EX9E), HANDLER(instr_EXA1),
+    HANDLER(instr_FN01), HANDLER(instr_FX07), HANDLER(instr_FX0A), HANDLER(instr_FX15), HANDLER(instr_FX18),
+    HANDLER(instr_FX1E), HANDLER(instr_FX29), HANDLER(instr_FX33), HANDLER_VARIANTS(instr_FX55),
+    HANDLER_VARIANTS(instr_FX65),
+};
+
+// Static view of the rom: which addresses hold reachable instructions and the blocks they form
+typedef struct aot_program
+{
+    chip8_t chip8;                  // Rom loaded as the emulator would, for decoding and idle loop detection
+    config_t config;
+    uint16_t end;                   // One past the last rom byte
+    bool reached[4096];             // An instruction starts here on some static path
+    int32_t block_of[4096];         // Block index of each reached instruction
+    aot_block_t blocks[4096];
+    uint32_t num_blocks;
+    uint32_t num_insts;
+    uint32_t num_bnnn_targets;      // Addresses added as possible BNNN targets
+} aot_program_t;
+
+static aot_program_t program;
+
+static void usage(const char *program_name)
+{
+    fprintf(stderr, "Usage: %s [--extension chip8|schip|xochip] [--out <file.c>] <rom>\n", program_name);
+}
+
+static const char *handler_name(instruction_func_t handler)
+{
+    for (size_t i = 0; i < sizeof(handler_names) / sizeof(handler_names[0]); i++)
+        if (handler_names[i].handler == handler)
+            return handler_names[i].name;
+    return NULL;
+}
+
+static uint16_t opcode_at(const aot_program_t *p, uint16_t address)
+{
+    return (uint16_t)(p->chip8.ram[address] << 8 | p->chip8.ram[address + 1]);
+}
+
+// Whole instruction inside the rom, anything else is left to the interpreter
+static bool in_rom(const aot_program_t *p, uint32_t address)
+{
+    return address >= AOT_ENTRY_POINT && address + 1 < p->end;
+}
+
+// Skips are every opcode that conditionally steps over the next instruction
+static bool is_skip(uint16_t opcode)
+{
+    switch ((opcode >> 12) & 0x0F)
+    {
+    case 0x3: case 0x4:
+        return true;
+    case 0x5: case 0x9:
+        return (opcode & 0x0F) == 0;
+    case 0xE:
+        return (opcode & 0xFF) == 0x9E || (opcode & 0xFF) == 0xA1;
+    default:
+        return false;
+    }
+}
+
+// Opcodes that change PC or may rewrite code end a block, same set the JIT stops at
+static bool ends_block(uint16_t opcode)
+{
+    switch ((opcode >> 12) & 0x0F)
+    {
+    case 0x1: case 0x2: case 0x3: case 0x4:
+    case 0x5: case 0x9: case 0xB: case 0xE:
+        return true;
+    case 0x0:
+        return opcode == 0x00EE || opcode == 0x00FD;
+    case 0xF:
+        return (opcode & 0xFF) == 0x0A || (opcode & 0xFF) == 0x33 || (opcode & 0xFF) == 0x55;
+    default:
+        return false;
+    }
+}
+
+static void push(uint16_t *worklist, uint32_t *count, aot_program_t *p, uint32_t address)
+{
+    if (in_rom(p, address) && !p->reached[address])
+    {
+        p->reached[address] = true;
+        worklist[(*count)++] = (uint16_t)address;
+    }
+}
+
+// Follow every static path from the entry point: jumps, calls and both sides of skips.
+// 00EE returns land after their call, BNNN may land anywhere in NNN..NNN+255
+static void discover(aot_program_t *p)
+{
+    static uint16_t worklist[4096];
+    uint32_t count = 0;
+
+    push(worklist, &count, p, AOT_ENTRY_POINT);
+    while (count)
+    {
+        const uint16_t address = worklist[--count];
+        const uint16_t opcode = opcode_at(p, address);
+        const uint16_t NNN = opcode & 0xFFF;
+
+        switch ((opcode >> 12) & 0x0F)
+        {
+        case 0x0:
+            if (opcode != 0x00EE && opcode != 0x00FD)
+                push(worklist, &count, p, address + 2u);
+            break;
+        case 0x1:
+            push(worklist, &count, p, NNN);
+            break;
+        case 0x2:
+            push(worklist, &count, p, NNN);
+            push(worklist, &count, p, address + 2u);
+            break;
+        case 0xB:
+            for (uint32_t v0 = 0; v0 <= 0xFF; v0++)
+            {
+                if (in_rom(p, NNN + v0) && !p->reached[NNN + v0])
+                    p->num_bnnn_targets++;
+                push(worklist, &count, p, NNN + v0);
+            }
+            break;
+        default:
+            push(worklist, &count, p, address + 2u);
+            if (is_skip(opcode))
+                push(worklist, &count, p, address + 4u);
+            break;
+        }
+    }
+}
+
+// Straight line runs of reached instructions, in address order
+static void find_blocks(aot_program_t *p)
+{
+    for (uint32_t i = 0; i < 4096; i++)
+        p->block_of[i] = -1;
+
+    for (uint32_t address = AOT_ENTRY_POINT; address < p->end; address++)
+    {
+        if (!p->reached[address] || p->block_of[address] >= 0)
+            continue;
+
+        aot_block_t *block = &p->blocks[p->num_blocks];
+        block->start = (uint16_t)address;
+        uint32_t a = address;
+        while (true)
+        {
+            p->block_of[a] = (int32_t)p->num_blocks;
+            p->num_insts++;
+            const bool last = ends_block(opcode_at(p, (uint16_t)a)) || !in_rom(p, a + 2) || !p->reached[a + 2];
+            a += 2;
+            if (last)
+                break;
+        }
+        block->end = (uint16_t)a;
+        p->num_blocks++;
+    }
+}
+
+// Continue at target, directly when it was translated
+static void emit_goto(FILE *out, const aot_program_t *p, uint32_t target)
+{
+    if (in_rom(p, target) && p->reached[target])
+        fprintf(out, "goto e_%03X;", target);
+    else
+        fprintf(out, "goto dispatch;");
+}
+
+static void emit_call(FILE *out, const char *handler, uint16_t opcode, uint16_t next)
+{
+    fprintf(out, "    AOT_CALL(%s, 0x%04X, 0x%03X);\n", handler, opcode, next);
+}
+
+// One instruction, plain C for the register ops the JIT also runs natively, the handler for everything else
+static void emit_instruction(FILE *out, const aot_program_t *p, uint16_t address)
+{
+    const uint16_t opcode = opcode_at(p, address);
+    const uint8_t X = (opcode >> 8) & 0x0F;
+    const uint8_t Y = (opcode >> 4) & 0x0F;
+    const uint8_t N = opcode & 0x0F;
+    const uint8_t NN = opcode & 0xFF;
+    const uint16_t NNN = opcode & 0xFFF;
+    const uint16_t next = address + 2;
+    const instruction_func_t handler = decode_opcode(p->chip8.handlers, opcode);
+    const bool chip8_quirks = p->config.current_extension == CHIP8;
+
+    fprintf(out, "i_%03X: // %04X\n", address, opcode);
+
+    switch ((opcode >> 12) & 0x0F)
+    {
+    case 0x1:
+        // Idle loops go through the handler so they flag chip8->idle
+        if (chip8_idle_jump(&p->chip8, address, NNN))
+        {
+            emit_call(out, "instr_1NNN", opcode, next);
+            fprintf(out, "    goto dispatch;\n");
+        }
+        else
+        {
+            fprintf(out, "    chip8->PC = 0x%03X;\n    ", NNN);
+            emit_goto(out, p, NNN);
+            fprintf(out, "\n");
+        }
+        return;
+    case 0x2:
+        emit_call(out, "instr_2NNN", opcode, next);
+        fprintf(out, "    ");
+        emit_goto(out, p, NNN);
+        fprintf(out, "\n");
+        return;
+    case 0x3:
+    case 0x4:
+    case 0x5:
+    case 0x9:
+    {
+        if (!is_skip(opcode))
+            break;
+        const char *op = ((opcode >> 12) & 0x0F) == 0x3 || ((opcode >> 12) & 0x0F) == 0x5 ? "==" : "!=";
+        char operand[16];
+        if (((opcode >> 12) & 0x0F) == 0x3 || ((opcode >> 12) & 0x0F) == 0x4)
+            snprintf(operand, sizeof(operand), "0x%02X", NN);
+        else
+            snprintf(operand, sizeof(operand), "V[0x%X]", Y);
+        fprintf(out, "    if (V[0x%X] %s %s)\n    {\n        chip8->PC = 0x%03X;\n        ", X, op, operand,
+                (uint16_t)(address + 4));
+        emit_goto(out, p, address + 4u);
+        fprintf(out, "\n    }\n    chip8->PC = 0x%03X;\n    ", next);
+        emit_goto(out, p, next);
+        fprintf(out, "\n");
+        return;
+    }
+    case 0x6:
+        fprintf(out, "    V[0x%X] = 0x%02X;\n", X, NN);
+        return;
+    case 0x7:
+        fprintf(out, "    V[0x%X] += 0x%02X;\n", X, NN);
+        return;
+    case 0x8:
+        switch (N)
+        {
+        case 0x0:
+            fprintf(out, "    V[0x%X] = V[0x%X];\n", X, Y);
+            return;
+        case 0x1:
+        case 0x2:
+        case 0x3:
+            fprintf(out, "    V[0x%X] %s= V[0x%X];\n", X, N == 1 ? "|" : N == 2 ? "&" : "^", Y);
+            if (chip8_quirks)
+                fprintf(out, "    V[0xF] = 0;\n"); // Chip-8 ONLY QUIRK
+            return;
+        case 0x4:
+            fprintf(out, "    carry = (uint16_t)(V[0x%X] + V[0x%X]) > 255;\n    V[0x%X] += V[0x%X];\n    V[0xF] = carry;\n",
+                    X, Y, X, Y);
+            return;
+        case 0x5:
+            fprintf(out, "    carry = V[0x%X] <= V[0x%X];\n    V[0x%X] -= V[0x%X];\n    V[0xF] = carry;\n", Y, X, X, Y);
+            return;
+        default:
+            break;
+        }
+        break;
+    case 0xA:
+        fprintf(out, "    chip8->I = 0x%03X;\n", NNN);
+        return;
+    default:
+        break;
+    }
+
+    // Everything else runs the handler the interpreter would pick for this extension
+    const char *name = handler_name(handler);
+    if (name)
+        emit_call(out, name, opcode, next);
+    else if (ends_block(opcode))
+        fprintf(out, "    chip8->PC = 0x%03X; // Does nothing on this extension\n", next);
+    else
+        fprintf(out, "    // Does nothing on this extension\n");
+
+    if (is_skip(opcode))
+    {
+        // Handler skipped or not, both sides were translated
+        fprintf(out, "    if (chip8->PC == 0x%03X)\n        ", (uint16_t)(address + 4));
+        emit_goto(out, p, address + 4u);
+        fprintf(out, "\n    ");
+        emit_goto(out, p, next);
+        fprintf(out, "\n");
+    }
+    else if (ends_block(opcode))
+    {
+        // Returns, BNNN, waits and ram writes, dispatch picks up where the handler left PC
+        fprintf(out, "    goto dispatch;\n");
+    }
+}
+
+static bool write_program(const aot_program_t *p, const char *rom_path, const char *out_path,
+                          const uint8_t *rom, size_t rom_size)
+{
+    FILE *out = fopen(out_path, "w");
+    if (!out)
+    {
+        fprintf(stderr, "Could not open %s for writing\n", out_path);
+        return false;
+    }
+
+    static const char *extension_names[NUM_EXTENSIONS] = {"CHIP8", "SUPERCHIP", "X0CHIP"};
+
+    fprintf(out, "// Generated by chip8-aot from %s, do not edit\n", rom_path);
+    fprintf(out, "// %u instructions in %u blocks\n", p->num_insts, p->num_blocks);
+    fprintf(out, "#include \"aot.h\"\n\n");
+
+    const char *name = rom_path;
+    for (const char *c = rom_path; *c; c++)
+        if (*c == '/' || *c == '\\')
+            name = c + 1;
+    fprintf(out, "const char aot_rom_name[] = \"");
+    for (const char *c = name; *c; c++)
+        fprintf(out, *c == '"' || *c == '\\' ? "\\%c" : "%c", *c);
+    fprintf(out, "\";\n");
+    fprintf(out, "const extension_t aot_extension = %s;\n", extension_names[p->config.current_extension]);
+    fprintf(out, "const size_t aot_rom_size = %zu;\n", rom_size);
+    fprintf(out, "const uint8_t aot_rom[] = {");
+    for (size_t i = 0; i < rom_size; i++)
+        fprintf(out, "%s0x%02X,", i % 16 ? " " : "\n    ", rom[i]);
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "#define NUM_BLOCKS %u\n\n", p->num_blocks);
+    fprintf(out, "static const aot_block_t blocks[NUM_BLOCKS] = {");
+    for (uint32_t i = 0; i < p->num_blocks; i++)
+        fprintf(out, "%s{0x%03X, 0x%03X},", i % 6 ? " " : "\n    ", p->blocks[i].start, p->blocks[i].end);
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "// Blocks whose ram no longer holds the rom's code, run by the interpreter instead\n");
+    fprintf(out, "static bool stale[NUM_BLOCKS];\n\n");
+
+    fprintf(out, "uint32_t aot_run(chip8_t *chip8, const config_t *config, uint32_t num_insts)\n{\n");
+    fprintf(out, "    uint8_t *const V = chip8->V;\n");
+    fprintf(out, "    uint32_t executed = 0;\n");
+    fprintf(out, "    bool carry;\n");
+    fprintf(out, "    (void)V;\n");
+    fprintf(out, "    (void)carry;\n");
+    fprintf(out, "    chip8->idle = false;\n\n");
+
+    fprintf(out, "dispatch:\n");
+    fprintf(out, "    if (executed >= num_insts || (chip8->idle && config->skip_idle))\n        return executed;\n");
+    fprintf(out, "    if (chip8->written_hi)\n        aot_check_writes(chip8, blocks, NUM_BLOCKS, stale);\n");
+    fprintf(out, "    switch (chip8->PC & 0xFFF)\n    {\n");
+    for (uint32_t a = AOT_ENTRY_POINT; a < p->end; a++)
+        if (p->reached[a])
+            fprintf(out, "    case 0x%03X: goto e_%03X;\n", a, a);
+    fprintf(out, "    default: break;\n    }\n\n");
+
+    fprintf(out, "interpret:\n");
+    fprintf(out, "    // Not translated, rewritten since, or the rest of the block doesn't fit in num_insts\n");
+    fprintf(out, "    if (executed >= num_insts)\n        return executed;\n");
+    fprintf(out, "    emulate_instruction(chip8, config);\n");
+    fprintf(out, "    executed++;\n");
+    fprintf(out, "    goto dispatch;\n\n");
+
+    // Entry per instruction, translated code runs from there to the end of its block only if it all fits
+    fprintf(out, "    // Entries, one per instruction\n");
+    for (uint32_t a = AOT_ENTRY_POINT; a < p->end; a++)
+    {
+        if (!p->reached[a])
+            continue;
+        const int32_t b = p->block_of[a];
+        const uint32_t remaining = (p->blocks[b].end - a) / 2;
+        fprintf(out, "e_%03X:\n    if (stale[%d] || num_insts - executed < %u)\n        goto interpret;\n"
+                     "    executed += %u;\n    goto i_%03X;\n", a, b, remaining, remaining, a);
+    }
+
+    for (uint32_t b = 0; b < p->num_blocks; b++)
+    {
+        const aot_block_t *block = &p->blocks[b];
+        fprintf(out, "\n    // Block %u: 0x%03X - 0x%03X\n", b, block->start, block->end - 1);
+        for (uint32_t a = block->start; a < block->end; a += 2)
+            emit_instruction(out, p, (uint16_t)a);
+
+        // Ran off the end of the block without a jump, fall through to what follows
+        const uint16_t last = opcode_at(p, (uint16_t)(block->end - 2));
+        if (!ends_block(last))
+        {
+            fprintf(out, "    chip8->PC = 0x%03X;\n    ", block->end);
+            emit_goto(out, p, block->end);
+            fprintf(out, "\n");
+        }
+    }
+    fprintf(out, "}\n");
+
+    const bool ok = !ferror(out);
+    fclose(out);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    const char *rom_path = NULL;
+    const char *out_path = NULL;
+    char default_out[1024];
+
+    char *defaults[] = {argv[0]};
+    set_config_from_args(&program.config, 1, defaults);
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--extension") == 0 && i + 1 < argc)
+            program.config.current_extension = extension_from_name(argv[++i]);
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+            out_path = argv[++i];
+        else if (argv[i][0] == '-' || rom_path)
+        {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        else
+            rom_path = argv[i];
+    }
+
+    if (!rom_path)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (!out_path)
+    {
+        snprintf(default_out, sizeof(default_out), "%s.c", rom_path);
+        out_path = default_out;
+    }
+
+    size_t rom_size;
+    uint8_t *rom = platform_read_file(rom_path, &rom_size);
+    if (!rom || rom_size < 2 || !chip8_load_rom(&program.chip8, &program.config, rom, rom_size))
+    {
+        fprintf(stderr, "Could not read rom %s\n", rom_path);
+        free(rom);
+        return EXIT_FAILURE;
+    }
+    program.end = (uint16_t)(AOT_ENTRY_POINT + rom_size);
+
+    discover(&program);
+    find_blocks(&program);
+
+    const bool ok = write_program(&program, rom_path, out_path, rom, rom_size);
+    if (ok)
+        printf("Translated %u instructions in %u blocks (%u possible BNNN targets) into %s\n",
+               program.num_insts, program.num_blocks, program.num_bnnn_targets, out_path);
+
+    free(rom);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,49 @@
+#ifndef AOT_H
+#define AOT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "type_defs.h"
+#include "app.h"
+#include "chip8.h"
+
+#define AOT_ENTRY_POINT 0x200       // Where roms are loaded and static disassembly starts
+
+// Straight line run of translated instructions, the ram it was translated from
+struct aot_block
+{
+    uint16_t start;
+    uint16_t end;                   // One past the last byte
+};
+
+// Run one instruction through its interpreter handler from translated code, fields folded at compile time
+#define AOT_CALL(handler, op, next)                                                     \
+    do                                                                                  \
+    {                                                                                   \
+        chip8->inst = (instruction_t){                                                  \
+            .opcode = (op),                                                             \
+            .NNN = (op) & 0xFFF,                                                        \
+            .NN = (op) & 0xFF,                                                          \
+            .N = (op) & 0x0F,                                                           \
+            .X = ((op) >> 8) & 0x0F,                                                    \
+            .Y = ((op) >> 4) & 0x0F,                                                    \
+        };                                                                              \
+        chip8->PC = (next);                                                             \
+        handler(chip8, config);                                                         \
+    } while (0)
+
+// Emitted by chip8-aot for one rom
+extern const char aot_rom_name[];
+extern const extension_t aot_extension;
+extern const uint8_t aot_rom[];
+extern const size_t aot_rom_size;
+
+// Same contract as chip8_step: up to num_insts instructions, stops early once idle
+uint32_t aot_run(chip8_t *chip8, const config_t *config, uint32_t num_insts);
+
+// Runtime shared by every translated rom, in aot_main.c
+void aot_check_writes(chip8_t *chip8, const aot_block_t *blocks, size_t num_blocks, bool *stale);
+
+#endif
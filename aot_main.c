@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app.h"
+#include "chip8.h"
+#include "aot.h"
+#include "verify.h"
+#include "platform.h"
+
+#define DEFAULT_FRAMES 600          // 10 seconds of emulated time, same as chip8-farm
+
+static chip8_t chip8;
+static chip8_t reference;
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [--frames N] [--ips N] [--seed N] [--check]\n", program);
+}
+
+// Mark translated blocks whose ram no longer matches the rom, after FX33/FX55 or a load wrote to it
+void aot_check_writes(chip8_t *chip8, const aot_block_t *blocks, size_t num_blocks, bool *stale)
+{
+    for (size_t i = 0; i < num_blocks; i++)
+    {
+        if (blocks[i].start >= chip8->written_hi || blocks[i].end <= chip8->written_lo)
+            continue;
+        stale[i] = memcmp(&chip8->ram[blocks[i].start], &aot_rom[blocks[i].start - AOT_ENTRY_POINT],
+                          blocks[i].end - blocks[i].start) != 0;
+    }
+    chip8->written_lo = 0xFFFF;
+    chip8->written_hi = 0;
+}
+
+// Runs the translated rom headless for a number of frames, optionally against the interpreter
+int main(int argc, char **argv)
+{
+    uint64_t frames = DEFAULT_FRAMES;
+    bool check = false;
+
+    config_t config = {0};
+    char *defaults[] = {argv[0]};
+    set_config_from_args(&config, 1, defaults);
+    config.current_extension = aot_extension;
+    config.seed = 0; // Same CXNN sequence every run, like chip8-farm
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            frames = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--ips") == 0 && i + 1 < argc)
+            config.insts_per_second = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+            config.seed = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--check") == 0)
+            check = true;
+        else
+        {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    chip8_load_rom(&chip8, &config, aot_rom, aot_rom_size);
+    if (check)
+        chip8_load_rom(&reference, &config, aot_rom, aot_rom_size);
+
+    // Same fractional split per 60hz frame as the frontend and chip8-farm
+    uint32_t remainder = 0;
+    uint64_t done = 0;
+    uint64_t ns = 0;
+    for (uint64_t frame = 0; frame < frames; frame++)
+    {
+        const uint32_t total = config.insts_per_second + remainder;
+        const uint32_t n = total / 60;
+        remainder = total % 60;
+
+        const uint64_t start = platform_now_ns();
+        const uint32_t ran = aot_run(&chip8, &config, n);
+        chip8_tick_timers(&chip8);
+        ns += platform_now_ns() - start;
+        done += ran;
+
+        // Interpreter gets the same budget, both have to stop at the same instruction
+        if (check)
+        {
+            const uint32_t reference_ran = chip8_step(&reference, &config, n);
+            chip8_tick_timers(&reference);
+            if (reference_ran != ran || verify_hash(&chip8) != verify_hash(&reference))
+            {
+                printf("%s diverged from the interpreter in frame %llu\n", aot_rom_name, (unsigned long long)frame);
+                verify_dump(stdout, &chip8, &reference);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    printf("%-16s %12s %10s  %s\n", "Hash", "Insts", "ms", "ROM");
+    printf("%016llx %12llu %10.3f  %s%s\n", (unsigned long long)verify_hash(&chip8), (unsigned long long)done,
+           (double)ns / 1e6, aot_rom_name, check ? " (matches the interpreter)" : "");
+    return EXIT_SUCCESS;
+}
@@ -1,8 +1,29 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "app.h"
+#include "rom_index.h"
+
+// chip8, schip or xochip, picks quirks and which extra opcodes run. Unknown names are plain CHIP8
+extension_t extension_from_name(const char *name)
+{
+    if (strcmp(name, "schip") == 0)
+        return SUPERCHIP;
+    if (strcmp(name, "xochip") == 0)
+        return X0CHIP;
+    return CHIP8;
+}
+
+// Options taking a value print usage when it's missing instead of reading past argv
+static bool has_value(int argc, char **argv, int i)
+{
+    if (i + 1 < argc)
+        return true;
+    fprintf(stderr, "Usage: %s <rom_name> [options], %s needs a value\n", argv[0], argv[i]);
+    return false;
+}
 
 // Set up initial emulator configuration from passed in arguments
 bool set_config_from_args(config_t *config, int argc, char **argv)
@@ -14,6 +35,8 @@ bool set_config_from_args(config_t *config, int argc, char **argv)
         .window_height = 32,            // Chip-8 original Y res
         .foreground_color = 0xFFFFFFFF, // Original color as white fg
         .background_color = 0x00000000, // Original color as black bg
+        .plane2_color = 0xFF5500FF,     // Octo style orange for the second XO-CHIP plane
+        .overlap_color = 0x555555FF,    // Gray where both planes are lit
         .scale_factor = 20,             // Default res will be 1280x640
         .pixel_outlines = true,         // Draw pixel outlines by default
         .insts_per_second = 700,        // Number of instructions to emulate in 1 second (clock rate of CPU)
@@ -22,8 +45,39 @@ bool set_config_from_args(config_t *config, int argc, char **argv)
         .volume = 3000,                 // INT16_MAX would be max volume
         .color_lerp_rate = 0.7f,        // Color lerp rate [0.1, 1.0]
         .current_extension = CHIP8,     // Current extension/quirks
+        .use_jit = false,               // Interpreter is the reference, JIT is opt in
+        .seed = (uint64_t)time(NULL),   // Different random numbers every run unless --seed is given
+        .turbo = false,                 // Real speed until Tab or --turbo
+        .turbo_speed = 0,               // Turbo runs uncapped
+        .index_path = ROM_INDEX_DEFAULT_PATH, // Rom profiles, if chip8-index was run
+        .record_path = NULL,            // Not recording unless --record is given
+        .record_scale = 0,              // Default recording size
+        .gdb_address = NULL,            // No debug stub unless --gdb is given
+        .trace = true,                  // Cheap enough to keep on, chip8-trace reads it after a crash
+        .trace_path = NULL,             // Next to the rom
+        .skip_idle = true,              // Nothing changes until the next timer tick or key event
     };
 
+    // Profile of the rom from the index first, so options below still override it
+    for (int i = 2; i + 1 < argc; i++)
+    {
+        if (strcmp(argv[i], "--index") == 0)
+            config->index_path = argv[i + 1];
+    }
+
+    rom_profile_t profile;
+    if (argc > 1 && rom_index_lookup(config->index_path, argv[1], &profile))
+    {
+        config->current_extension = profile.extension;
+        if (profile.insts_per_second)
+            config->insts_per_second = profile.insts_per_second;
+        if (profile.flags & ROM_PROFILE_COLORS)
+        {
+            config->foreground_color = profile.foreground_color;
+            config->background_color = profile.background_color;
+        }
+    }
+
     // Override defaults
     for (int i = 1; i < argc; i++)
     {   
@@ -32,6 +86,67 @@ bool set_config_from_args(config_t *config, int argc, char **argv)
             i++;
             config->scale_factor = (uint32_t)strtoul(argv[i], NULL, 10);
         }
+        else if(strncmp(argv[i], "--extension", strlen("--extension")) == 0) {
+            if (!has_value(argc, argv, i))
+                return false;
+            i++;
+            config->current_extension = extension_from_name(argv[i]);
+        }
+        else if(strncmp(argv[i], "--index", strlen("--index")) == 0) {
+            i++; // Already used for the profile lookup
+        }
+        else if(strncmp(argv[i], "--record-scale", strlen("--record-scale")) == 0) {
+            if (!has_value(argc, argv, i))
+                return false;
+            i++;
+            config->record_scale = (uint32_t)strtoul(argv[i], NULL, 10);
+        }
+        else if(strncmp(argv[i], "--record", strlen("--record")) == 0) {
+            if (!has_value(argc, argv, i))
+                return false;
+            i++;
+            config->record_path = argv[i];
+        }
+        else if(strncmp(argv[i], "--gdb", strlen("--gdb")) == 0) {
+            if (!has_value(argc, argv, i))
+                return false;
+            i++;
+            config->gdb_address = argv[i];
+        }
+        else if(strncmp(argv[i], "--trace", strlen("--trace")) == 0) {
+            if (!has_value(argc, argv, i))
+                return false;
+            i++;
+            config->trace_path = argv[i];
+        }
+        else if(strncmp(argv[i], "--no-trace", strlen("--no-trace")) == 0) {
+            config->trace = false;
+        }
+        else if(strncmp(argv[i], "--jit", strlen("--jit")) == 0) {
+            config->use_jit = true;
+        }
+        else if(strncmp(argv[i], "--seed", strlen("--seed")) == 0) {
+            if (!has_value(argc, argv, i))
+                return false;
+            i++;
+            config->seed = strtoull(argv[i], NULL, 10);
+        }
+        else if(strncmp(argv[i], "--ips", strlen("--ips")) == 0) {
+            if (!has_value(argc, argv, i))
+                return false;
+            i++;
+            config->insts_per_second = (uint32_t)strtoul(argv[i], NULL, 10);
+            if (!config->insts_per_second) {
+                fprintf(stderr, "--ips needs a positive number of instructions per second, got %s\n", argv[i]);
+                return false;
+            }
+        }
+        else if(strncmp(argv[i], "--turbo", strlen("--turbo")) == 0) {
+            // Optional multiplier, bare --turbo runs uncapped
+            config->turbo = true;
+            if (i + 1 < argc && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9')
+                config->turbo_speed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
     }
 
     return true;
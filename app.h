@@ -11,6 +11,7 @@ enum extension
     CHIP8 = 0,
     SUPERCHIP,
     X0CHIP,
+    NUM_EXTENSIONS,
 };
 
 struct config
@@ -19,6 +20,8 @@ struct config
     uint32_t window_height;         // SDL Window Height
     uint32_t foreground_color;      // Foreground color RGBA8888
     uint32_t background_color;      // Background color RGBA8888
+    uint32_t plane2_color;          // XO-CHIP pixels lit only in the second plane RGBA8888
+    uint32_t overlap_color;         // XO-CHIP pixels lit in both planes RGBA8888
     uint32_t scale_factor;          // Chip8 pixel scale by
     bool pixel_outlines;            // Draw pixel outlines
     uint32_t insts_per_second;      // CHIP8 CPU "clock-rate" or hz
@@ -27,8 +30,21 @@ struct config
     int16_t volume;                 // How loud is sound
     float color_lerp_rate;          // Amout to lerp colors by, between [0.1, 1.0]
     extension_t current_extension;  // Current extension support for e.g CHIP8 vs SUPERCHIP
+    bool use_jit;                   // Run hot code through the x86-64 JIT instead of the interpreter
+    uint64_t seed;                  // CXNN random seed, same seed and input replay bit for bit
+    bool turbo;                     // Fast forward, emulate more than one frame per displayed frame
+    uint32_t turbo_speed;           // Emulated frames per displayed frame in turbo, 0 for as many as fit
+    const char *index_path;         // chip8-index file with per rom profiles, NULL to skip the lookup
+    const char *record_path;        // Record the display to this .y4m or .gif, NULL when not recording
+    uint32_t record_scale;          // Recorded pixels per hires pixel, 0 for the default
+    const char *gdb_address;        // Debug stub TCP port or Unix socket path, NULL for no stub
+    bool trace;                     // Record executed instructions to the trace ring
+    bool skip_idle;                 // Idle roms end the frame early, off to keep spinning like hardware
+    const char *trace_path;         // Trace ring file, NULL for <rom>.trace
 };
 
+extension_t extension_from_name(const char *name);
+
 // Set up initial emulator configuration from passed in arguments
 bool set_config_from_args(config_t *config, int argc, char **argv);
 
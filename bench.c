@@ -0,0 +1,370 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "app.h"
+#include "chip8.h"
+#include "instruction_tables.h"
+#include "jit.h"
+#include "exec_trace.h"
+#include "platform.h"
+
+#define DEFAULT_INSTS 2000000   // Instruction budget per run
+#define DEFAULT_RUNS 5          // Repeated runs per ROM for variance
+#define PROFILE_INSTS 200000    // Instructions timed one by one for the opcode class breakdown
+
+#ifndef CHIP8_SOURCE_DIR
+#define CHIP8_SOURCE_DIR "."
+#endif
+
+// Bundled test rom submodules
+static const char *default_rom_dirs[] = {
+    "test-roms/chip8-test-suite",
+    "test-roms/chip8-test-rom",
+    "test-roms/chip8-roms",
+};
+
+// Synthetic loops hammering one opcode class each
+typedef struct micro_bench
+{
+    const char *name;
+    opcode_class_t target;
+    uint8_t rom[16];
+    size_t rom_size;
+} micro_bench_t;
+
+static const micro_bench_t micro_benches[] = {
+    // A000 D015 7003 7101 1202: draw font sprite while walking across the screen
+    {"micro/DXYN", OP_DXYN, {0xA0, 0x00, 0xD0, 0x15, 0x70, 0x03, 0x71, 0x01, 0x12, 0x02}, 10},
+    // A300 F033 7001 1202: BCD of a counter into data ram
+    {"micro/FX33", OP_FX33, {0xA3, 0x00, 0xF0, 0x33, 0x70, 0x01, 0x12, 0x02}, 8},
+    // A300 FF55 A300 FF65 1200: dump and reload all registers
+    {"micro/FX55", OP_FX55, {0xA3, 0x00, 0xFF, 0x55, 0xA3, 0x00, 0xFF, 0x65, 0x12, 0x00}, 10},
+    {"micro/FX65", OP_FX65, {0xA3, 0x00, 0xFF, 0x55, 0xA3, 0x00, 0xFF, 0x65, 0x12, 0x00}, 10},
+};
+
+typedef struct bench_result
+{
+    const char *name;
+    const char *engine;
+    double ips_mean;
+    double ips_stddev;
+    double ips_min;
+    double ips_max;
+    uint64_t class_count[NUM_OPCODE_CLASSES];
+    double class_ns[NUM_OPCODE_CLASSES];    // Mean ns per instruction, interpreter only
+} bench_result_t;
+
+static chip8_t chip8;
+static jit_t jit;
+static trace_t trace;
+
+// Run insts instructions uncapped, timers tick every emulated 60hz frame
+static double run_once(const uint8_t *rom, size_t rom_size, const config_t *config, bool use_jit, uint64_t insts)
+{
+    const uint32_t per_frame = config->insts_per_second / 60;
+
+    chip8_load_rom(&chip8, config, rom, rom_size);
+    if (use_jit)
+        jit_flush(&jit);
+
+    const uint64_t start = platform_now_ns();
+    // skip_idle is off, every frame runs its whole budget even in idle loops
+    for (uint64_t done = 0; done < insts;)
+    {
+        const uint32_t n = (uint32_t)(insts - done < per_frame ? insts - done : per_frame);
+        if (use_jit)
+            done += jit_run(&jit, &chip8, config, n);
+        else
+            done += chip8_step(&chip8, config, n);
+        chip8_tick_timers(&chip8);
+    }
+    const uint64_t end = platform_now_ns();
+
+    return (double)(end - start) / 1e9;
+}
+
+// Cost of reading the clock twice, subtracted from per instruction timings
+static double timer_overhead_ns(void)
+{
+    uint64_t best = UINT64_MAX;
+    for (int i = 0; i < 10000; i++)
+    {
+        const uint64_t t0 = platform_now_ns();
+        const uint64_t t1 = platform_now_ns();
+        if (t1 - t0 < best)
+            best = t1 - t0;
+    }
+    return (double)best;
+}
+
+// Time every instruction on its own to split cost by opcode class
+static void profile_classes(bench_result_t *result, const uint8_t *rom, size_t rom_size,
+                            const config_t *config, uint64_t insts, double overhead)
+{
+    const uint32_t per_frame = config->insts_per_second / 60;
+    double total_ns[NUM_OPCODE_CLASSES] = {0};
+
+    chip8_load_rom(&chip8, config, rom, rom_size);
+
+    for (uint64_t i = 0; i < insts; i++)
+    {
+        const uint16_t address = chip8.PC & 0xFFF;
+        const uint16_t opcode = (chip8.ram[address] << 8) | chip8.ram[(address + 1) & 0xFFF];
+        const opcode_class_t class = opcode_class(decode_opcode(chip8.handlers, opcode), opcode);
+
+        const uint64_t t0 = platform_now_ns();
+        emulate_instruction(&chip8, config);
+        const uint64_t t1 = platform_now_ns();
+
+        const double ns = (double)(t1 - t0) - overhead;
+        total_ns[class] += ns > 0 ? ns : 0;
+        result->class_count[class]++;
+
+        if ((i + 1) % per_frame == 0)
+            chip8_tick_timers(&chip8);
+    }
+
+    for (int c = 0; c < NUM_OPCODE_CLASSES; c++)
+        if (result->class_count[c])
+            result->class_ns[c] = total_ns[c] / (double)result->class_count[c];
+}
+
+static void bench_rom(bench_result_t *result, const char *name, const uint8_t *rom, size_t rom_size,
+                      const config_t *config, bool use_jit, uint64_t insts, int runs, double overhead)
+{
+    double sum = 0, sum_sq = 0;
+
+    memset(result, 0, sizeof(*result));
+    result->name = name;
+    result->engine = use_jit ? "jit" : "interpreter";
+    result->ips_min = INFINITY;
+
+    // Warm up caches, JIT hit counters and branch predictors
+    run_once(rom, rom_size, config, use_jit, insts / 10 + 1);
+
+    for (int r = 0; r < runs; r++)
+    {
+        const double seconds = run_once(rom, rom_size, config, use_jit, insts);
+        const double ips = (double)insts / (seconds > 0 ? seconds : 1e-9);
+        sum += ips;
+        sum_sq += ips * ips;
+        if (ips < result->ips_min) result->ips_min = ips;
+        if (ips > result->ips_max) result->ips_max = ips;
+    }
+
+    result->ips_mean = sum / runs;
+    const double variance = sum_sq / runs - result->ips_mean * result->ips_mean;
+    result->ips_stddev = variance > 0 ? sqrt(variance) : 0;
+
+    if (!use_jit)
+        profile_classes(result, rom, rom_size, config, insts < PROFILE_INSTS ? insts : PROFILE_INSTS, overhead);
+}
+
+static void print_table(const bench_result_t *results, size_t count)
+{
+    printf("%-48s %-12s %14s %10s %10s\n", "ROM", "Engine", "Inst/s", "+-%", "ns/inst");
+    for (size_t i = 0; i < count; i++)
+    {
+        const bench_result_t *r = &results[i];
+        printf("%-48.48s %-12s %14.0f %9.2f%% %10.2f\n", r->name, r->engine, r->ips_mean,
+               r->ips_mean > 0 ? 100.0 * r->ips_stddev / r->ips_mean : 0.0,
+               r->ips_mean > 0 ? 1e9 / r->ips_mean : 0.0);
+    }
+
+    // Opcode class breakdown over every interpreter run
+    uint64_t count_total[NUM_OPCODE_CLASSES] = {0};
+    double ns_total[NUM_OPCODE_CLASSES] = {0};
+    for (size_t i = 0; i < count; i++)
+    {
+        for (int c = 0; c < NUM_OPCODE_CLASSES; c++)
+        {
+            count_total[c] += results[i].class_count[c];
+            ns_total[c] += results[i].class_ns[c] * (double)results[i].class_count[c];
+        }
+    }
+
+    printf("\n%-8s %14s %10s\n", "Opcode", "Executed", "ns/inst");
+    for (int c = 0; c < NUM_OPCODE_CLASSES; c++)
+    {
+        if (count_total[c])
+            printf("%-8s %14llu %10.2f\n", opcode_class_names[c], (unsigned long long)count_total[c],
+                   ns_total[c] / (double)count_total[c]);
+    }
+}
+
+static void print_json_string(FILE *out, const char *s)
+{
+    fputc('"', out);
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\')
+            fputc('\\', out);
+        fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+static void write_json(FILE *out, const bench_result_t *results, size_t count, uint64_t insts, int runs)
+{
+    fprintf(out, "{\n  \"instructions_per_run\": %llu,\n  \"runs\": %d,\n  \"results\": [\n",
+            (unsigned long long)insts, runs);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const bench_result_t *r = &results[i];
+        fprintf(out, "    {\"rom\": ");
+        print_json_string(out, r->name);
+        fprintf(out, ", \"engine\": \"%s\", \"ips_mean\": %.1f, \"ips_stddev\": %.1f, "
+                     "\"ips_min\": %.1f, \"ips_max\": %.1f, \"opcodes\": {",
+                r->engine, r->ips_mean, r->ips_stddev, r->ips_min, r->ips_max);
+
+        bool first = true;
+        for (int c = 0; c < NUM_OPCODE_CLASSES; c++)
+        {
+            if (!r->class_count[c])
+                continue;
+            fprintf(out, "%s\"%s\": {\"count\": %llu, \"ns\": %.2f}", first ? "" : ", ", opcode_class_names[c],
+                    (unsigned long long)r->class_count[c], r->class_ns[c]);
+            first = false;
+        }
+        fprintf(out, "}}%s\n", i + 1 < count ? "," : "");
+    }
+
+    fprintf(out, "  ]\n}\n");
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [--insts N] [--runs N] [--jit] [--trace <file>] [--json <file|->] [rom or directory ...]\n", program);
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t insts = DEFAULT_INSTS;
+    int runs = DEFAULT_RUNS;
+    bool with_jit = false;
+    const char *json_path = NULL;
+    char **roms = NULL;
+    size_t num_roms = 0;
+
+    config_t config = {0};
+    char *defaults[] = {argv[0]};
+    set_config_from_args(&config, 1, defaults);
+    config.seed = 0; // Same CXNN sequence every run
+    config.skip_idle = false; // Idle loops keep running, so every rom measures full frames of instructions
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--insts") == 0 && i + 1 < argc)
+            insts = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc)
+            runs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--jit") == 0)
+            with_jit = true;
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+            json_path = argv[++i];
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            // Same ring the emulator keeps, to measure what tracing costs
+            if (!trace_create(&trace, argv[++i], TRACE_DEFAULT_RECORDS, config.current_extension))
+                return EXIT_FAILURE;
+            chip8.trace = &trace;
+        }
+        else if (argv[i][0] == '-')
+        {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        else if (!platform_find_roms(argv[i], &roms, &num_roms))
+            fprintf(stderr, "Skipping %s, not found\n", argv[i]);
+    }
+
+    if (insts == 0 || runs <= 0)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // No roms given, use the bundled test rom submodules
+    if (argc == 1 || !num_roms)
+    {
+        for (size_t i = 0; i < sizeof(default_rom_dirs) / sizeof(default_rom_dirs[0]); i++)
+        {
+            char path[4096];
+            if (platform_find_roms(default_rom_dirs[i], &roms, &num_roms))
+                continue;
+            snprintf(path, sizeof(path), "%s/%s", CHIP8_SOURCE_DIR, default_rom_dirs[i]);
+            if (!platform_find_roms(path, &roms, &num_roms))
+                fprintf(stderr, "Skipping %s, run git submodule update --init\n", default_rom_dirs[i]);
+        }
+    }
+
+    if (with_jit && !init_jit(&jit))
+        with_jit = false;
+
+    const size_t num_micro = sizeof(micro_benches) / sizeof(micro_benches[0]);
+    const size_t max_results = (num_roms + num_micro) * (with_jit ? 2 : 1);
+    bench_result_t *results = calloc(max_results ? max_results : 1, sizeof(bench_result_t));
+    size_t num_results = 0;
+    const double overhead = timer_overhead_ns();
+
+    for (size_t i = 0; i < num_roms; i++)
+    {
+        size_t rom_size = 0;
+        uint8_t *rom = platform_read_file(roms[i], &rom_size);
+        if (!rom || rom_size > sizeof(chip8.ram) - 0x200)
+        {
+            fprintf(stderr, "Skipping %s, could not load\n", roms[i]);
+            free(rom);
+            continue;
+        }
+
+        bench_rom(&results[num_results++], roms[i], rom, rom_size, &config, false, insts, runs, overhead);
+        if (with_jit)
+            bench_rom(&results[num_results++], roms[i], rom, rom_size, &config, true, insts, runs, overhead);
+        free(rom);
+    }
+
+    for (size_t i = 0; i < num_micro; i++)
+    {
+        const micro_bench_t *micro = &micro_benches[i];
+        bench_result_t *result = &results[num_results++];
+        bench_rom(result, micro->name, micro->rom, micro->rom_size, &config, false, insts, runs, overhead);
+
+        // Micro benchmark reports only the opcode it targets
+        for (int c = 0; c < NUM_OPCODE_CLASSES; c++)
+        {
+            if (c != (int)micro->target)
+            {
+                result->class_count[c] = 0;
+                result->class_ns[c] = 0;
+            }
+        }
+
+        if (with_jit)
+            bench_rom(&results[num_results++], micro->name, micro->rom, micro->rom_size, &config, true, insts, runs, overhead);
+    }
+
+    print_table(results, num_results);
+
+    if (json_path)
+    {
+        FILE *out = strcmp(json_path, "-") == 0 ? stdout : fopen(json_path, "w");
+        if (!out)
+            fprintf(stderr, "Could not open %s for writing\n", json_path);
+        else
+        {
+            write_json(out, results, num_results, insts, runs);
+            if (out != stdout)
+                fclose(out);
+        }
+    }
+
+    free(results);
+    platform_free_roms(roms, num_roms);
+    destroy_jit(&jit);
+    trace_close(&trace);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,378 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "capture.h"
+#include "app.h"
+
+// GIF data sub-blocks being filled with LZW codes, least significant bit first
+typedef struct gif_bits
+{
+    FILE *file;
+    uint8_t block[255];
+    uint32_t used;
+    uint32_t bits;
+    uint32_t count;
+} gif_bits_t;
+
+static void put_u16(FILE *file, uint16_t value)
+{
+    fputc(value & 0xFF, file);
+    fputc(value >> 8, file);
+}
+
+static void gif_flush_block(gif_bits_t *out)
+{
+    fputc((int)out->used, out->file);
+    fwrite(out->block, 1, out->used, out->file);
+    out->used = 0;
+}
+
+static void gif_put_code(gif_bits_t *out, uint32_t code, uint32_t size)
+{
+    out->bits |= code << out->count;
+    out->count += size;
+    while (out->count >= 8)
+    {
+        out->block[out->used++] = out->bits & 0xFF;
+        out->bits >>= 8;
+        out->count -= 8;
+        if (out->used == sizeof(out->block))
+            gif_flush_block(out);
+    }
+}
+
+// LZW compress palette indices into image data, 2 bit minimum code size for the 4 color palette
+static void gif_write_pixels(capture_t *capture, const uint8_t *pixels, size_t count)
+{
+    const uint32_t min_code_size = 2;
+    const uint32_t clear = 1u << min_code_size;
+    gif_bits_t out = {.file = capture->file};
+    uint32_t code_size = min_code_size + 1;
+    uint32_t max_code = clear + 1;
+
+    memset(capture->lzw, 0, CAPTURE_GIF_MAX_CODES * sizeof(*capture->lzw));
+    fputc((int)min_code_size, capture->file);
+    gif_put_code(&out, clear, code_size);
+
+    uint32_t current = pixels[0];
+    for (size_t i = 1; i < count; i++)
+    {
+        const uint8_t next = pixels[i];
+        if (capture->lzw[current][next])
+        {
+            current = capture->lzw[current][next];
+            continue;
+        }
+
+        gif_put_code(&out, current, code_size);
+        capture->lzw[current][next] = (uint16_t)++max_code;
+        if (max_code >= (1u << code_size))
+            code_size++;
+
+        // Table full, start over rather than carry on with stale codes
+        if (max_code == CAPTURE_GIF_MAX_CODES - 1)
+        {
+            gif_put_code(&out, clear, code_size);
+            memset(capture->lzw, 0, CAPTURE_GIF_MAX_CODES * sizeof(*capture->lzw));
+            code_size = min_code_size + 1;
+            max_code = clear + 1;
+        }
+        current = next;
+    }
+
+    gif_put_code(&out, current, code_size);
+    gif_put_code(&out, clear, code_size);
+    gif_put_code(&out, clear + 1, min_code_size + 1);
+    if (out.count)
+        gif_put_code(&out, 0, 8 - out.count);
+    if (out.used)
+        gif_flush_block(&out);
+    fputc(0, capture->file);
+}
+
+// Global 4 color palette and loop forever
+static void gif_write_header(capture_t *capture)
+{
+    fwrite("GIF89a", 1, 6, capture->file);
+    put_u16(capture->file, (uint16_t)capture->width);
+    put_u16(capture->file, (uint16_t)capture->height);
+    fputc(0x91, capture->file);     // Global color table of 4 entries, 2 bit color resolution
+    fputc(0, capture->file);        // Background color index
+    fputc(0, capture->file);        // Square pixels
+    for (int i = 0; i < 4; i++)
+    {
+        fputc((capture->palette[i] >> 24) & 0xFF, capture->file);
+        fputc((capture->palette[i] >> 16) & 0xFF, capture->file);
+        fputc((capture->palette[i] >> 8) & 0xFF, capture->file);
+    }
+
+    fwrite("\x21\xFF\x0BNETSCAPE2.0\x03\x01\x00\x00\x00", 1, 19, capture->file);
+}
+
+// Frame in pixels, shown until frame number end. Browsers slow delays under 2/100s down to 1/10s,
+// so short frames get 2/100s and the timeline catches up on frames that stay up longer
+static void gif_write_frame(capture_t *capture, uint64_t end)
+{
+    const uint64_t end_cs = end * 100 / CAPTURE_FPS;
+    uint64_t delay = end_cs > capture->written_cs ? end_cs - capture->written_cs : 0;
+    if (delay < 2)
+        delay = 2;
+    if (delay > 0xFFFF)
+        delay = 0xFFFF;
+    capture->written_cs += delay;
+
+    fwrite("\x21\xF9\x04\x00", 1, 4, capture->file); // Graphic control, no transparency
+    put_u16(capture->file, (uint16_t)delay);
+    fwrite("\x00\x00", 1, 2, capture->file);
+
+    fputc(0x2C, capture->file);     // Whole screen image, no local color table, not interlaced
+    put_u16(capture->file, 0);
+    put_u16(capture->file, 0);
+    put_u16(capture->file, (uint16_t)capture->width);
+    put_u16(capture->file, (uint16_t)capture->height);
+    fputc(0, capture->file);
+    gif_write_pixels(capture, capture->pixels, (size_t)capture->width * capture->height);
+}
+
+static void y4m_write_header(capture_t *capture)
+{
+    fprintf(capture->file, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 %s XCOLORRANGE=LIMITED\n", capture->width,
+            capture->height, CAPTURE_FPS, capture->subsample ? "C420jpeg" : "C444");
+}
+
+// Y plane at full size, then Cb and Cr, halved both ways for 4:2:0
+static void y4m_write_frame(capture_t *capture)
+{
+    const uint32_t step = capture->subsample ? 2 : 1;
+
+    fputs("FRAME\n", capture->file);
+    for (int c = 0; c < 3; c++)
+    {
+        const uint32_t s = c ? step : 1;
+        for (uint32_t y = 0; y < capture->height; y += s)
+        {
+            const uint8_t *row = &capture->pixels[(size_t)y * capture->width];
+            for (uint32_t x = 0; x < capture->width; x += s)
+                capture->line[x / s] = capture->yuv[row[x]][c];
+            fwrite(capture->line, 1, capture->width / s, capture->file);
+        }
+    }
+}
+
+// Palette indices per hires pixel, scaled up by repeating each pixel and row. Lores pixels cover 2x2
+static void expand_frame(capture_t *capture, const capture_frame_t *frame)
+{
+    const uint32_t scale = capture->scale;
+    uint8_t row[DISPLAY_WIDTH];
+
+    for (uint32_t y = 0; y < DISPLAY_HEIGHT; y++)
+    {
+        const uint32_t source_y = frame->hires ? y : y / 2;
+        for (uint32_t x = 0; x < DISPLAY_WIDTH; x++)
+        {
+            const uint32_t source_x = frame->hires ? x : x / 2;
+            uint8_t index = 0;
+            for (int plane = 0; plane < DISPLAY_PLANES; plane++)
+                index |= (uint8_t)(((frame->display[plane][source_y][source_x / 64] >> (63 - source_x % 64)) & 1) << plane);
+            row[x] = index;
+        }
+
+        uint8_t *out = &capture->pixels[(size_t)y * scale * capture->width];
+        for (uint32_t x = 0; x < DISPLAY_WIDTH; x++)
+            memset(&out[x * scale], row[x], scale);
+        for (uint32_t r = 1; r < scale; r++)
+            memcpy(&out[(size_t)r * capture->width], out, capture->width);
+    }
+}
+
+static bool same_frame(const capture_frame_t *a, const capture_frame_t *b)
+{
+    return a->hires == b->hires && memcmp(a->display, b->display, sizeof(a->display)) == 0;
+}
+
+static void encode_frame(capture_t *capture, const capture_frame_t *frame)
+{
+    if (capture->format == CAPTURE_GIF)
+    {
+        // Unchanged frames only lengthen the delay of the one on screen
+        if (capture->pending && same_frame(&capture->last, frame))
+            return;
+        if (capture->pending)
+            gif_write_frame(capture, frame->number);
+        capture->last = *frame;
+        capture->pending = true;
+        expand_frame(capture, frame);
+        return;
+    }
+
+    // Dropped frames are filled in with the frame before them, the stream stays at 60hz
+    if (capture->next_number)
+        for (uint64_t n = capture->next_number; n < frame->number; n++)
+            y4m_write_frame(capture);
+    expand_frame(capture, frame);
+    y4m_write_frame(capture);
+}
+
+static int SDLCALL capture_thread(void *data)
+{
+    capture_t *capture = data;
+
+    for (;;)
+    {
+        SDL_WaitSemaphore(capture->ready);
+
+        const uint32_t tail = (uint32_t)SDL_GetAtomicInt(&capture->tail);
+        uint32_t head = (uint32_t)SDL_GetAtomicInt(&capture->head);
+        for (; head != tail; head++)
+        {
+            const capture_frame_t *frame = &capture->ring[head % CAPTURE_RING_SIZE];
+            if (!capture->failed)
+            {
+                encode_frame(capture, frame);
+                capture->failed = ferror(capture->file) != 0;
+            }
+            capture->next_number = frame->number + 1;
+            SDL_SetAtomicInt(&capture->head, (int)(head + 1));
+        }
+
+        if (!SDL_GetAtomicInt(&capture->running) && head == (uint32_t)SDL_GetAtomicInt(&capture->tail))
+            break;
+    }
+
+    if (capture->format == CAPTURE_GIF && !capture->failed)
+    {
+        if (capture->pending)
+            gif_write_frame(capture, capture->next_number);
+        fputc(0x3B, capture->file); // Trailer
+    }
+    return 0;
+}
+
+// BT.601 limited range, offsets keep the shifted values positive
+static void palette_to_yuv(capture_t *capture)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        const int32_t r = (capture->palette[i] >> 24) & 0xFF;
+        const int32_t g = (capture->palette[i] >> 16) & 0xFF;
+        const int32_t b = (capture->palette[i] >> 8) & 0xFF;
+        capture->yuv[i][0] = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        capture->yuv[i][1] = (uint8_t)(((-38 * r - 74 * g + 112 * b + 128 + (128 << 8)) >> 8));
+        capture->yuv[i][2] = (uint8_t)(((112 * r - 94 * g - 18 * b + 128 + (128 << 8)) >> 8));
+    }
+}
+
+// Start recording to path, .gif for GIF and anything else raw Y4M. scale 0 for the default
+bool init_capture(capture_t *capture, const config_t *config, const char *path, uint32_t scale)
+{
+    memset(capture, 0, sizeof(capture_t));
+
+    const char *extension = strrchr(path, '.');
+    capture->path = path;
+    capture->format = extension && (strcmp(extension, ".gif") == 0 || strcmp(extension, ".GIF") == 0)
+                          ? CAPTURE_GIF : CAPTURE_Y4M;
+    capture->scale = scale ? scale : CAPTURE_DEFAULT_SCALE;
+    capture->width = DISPLAY_WIDTH * capture->scale;
+    capture->height = DISPLAY_HEIGHT * capture->scale;
+    capture->subsample = capture->scale % 2 == 0;
+
+    // Indexed by plane bits like the screen: background, first plane, second plane, both
+    capture->palette[0] = config->background_color;
+    capture->palette[1] = config->foreground_color;
+    capture->palette[2] = config->plane2_color;
+    capture->palette[3] = config->overlap_color;
+    palette_to_yuv(capture);
+
+    if (capture->width > 0xFFFF)
+    {
+        SDL_Log("Capture scale %u is too big\n", capture->scale);
+        return false;
+    }
+
+    capture->ring = calloc(CAPTURE_RING_SIZE, sizeof(capture_frame_t));
+    capture->pixels = malloc((size_t)capture->width * capture->height);
+    capture->line = malloc(capture->width);
+    if (capture->format == CAPTURE_GIF)
+        capture->lzw = malloc(CAPTURE_GIF_MAX_CODES * sizeof(*capture->lzw));
+    if (!capture->ring || !capture->pixels || !capture->line || (capture->format == CAPTURE_GIF && !capture->lzw))
+    {
+        SDL_Log("Could not allocate capture buffers\n");
+        destroy_capture(capture);
+        return false;
+    }
+
+    capture->file = fopen(path, "wb");
+    if (!capture->file)
+    {
+        SDL_Log("Could not open %s for recording\n", path);
+        destroy_capture(capture);
+        return false;
+    }
+
+    if (capture->format == CAPTURE_GIF)
+        gif_write_header(capture);
+    else
+        y4m_write_header(capture);
+
+    SDL_SetAtomicInt(&capture->running, 1);
+    capture->ready = SDL_CreateSemaphore(0);
+    if (capture->ready)
+        capture->thread = SDL_CreateThread(capture_thread, "capture", capture);
+    if (!capture->thread)
+    {
+        SDL_Log("Could not start capture thread %s\n", SDL_GetError());
+        destroy_capture(capture);
+        return false;
+    }
+
+    return true;
+}
+
+// Copy the display into the ring for the writer, called once per 60hz frame. Never blocks,
+// drops the frame if the writer is that far behind
+bool capture_push(capture_t *capture, const chip8_t *chip8)
+{
+    const uint32_t tail = (uint32_t)SDL_GetAtomicInt(&capture->tail);
+    const uint32_t head = (uint32_t)SDL_GetAtomicInt(&capture->head);
+    const uint64_t number = capture->frames++;
+
+    if (tail - head >= CAPTURE_RING_SIZE)
+    {
+        capture->dropped++;
+        return false;
+    }
+
+    capture_frame_t *frame = &capture->ring[tail % CAPTURE_RING_SIZE];
+    memcpy(frame->display, chip8->display, sizeof(frame->display));
+    frame->hires = chip8->hires;
+    frame->number = number;
+
+    // Frame contents visible to the writer before the new tail
+    SDL_SetAtomicInt(&capture->tail, (int)(tail + 1));
+    SDL_SignalSemaphore(capture->ready);
+    return true;
+}
+
+// Let the writer finish the queued frames, then close the file
+void destroy_capture(capture_t *capture)
+{
+    if (capture->thread)
+    {
+        SDL_SetAtomicInt(&capture->running, 0);
+        SDL_SignalSemaphore(capture->ready);
+        SDL_WaitThread(capture->thread, NULL);
+        printf("Recorded %llu frames (%llu dropped) to %s\n", (unsigned long long)capture->frames,
+               (unsigned long long)capture->dropped, capture->path);
+    }
+    if (capture->ready)
+        SDL_DestroySemaphore(capture->ready);
+    if (capture->file && (fclose(capture->file) != 0 || capture->failed))
+        SDL_Log("Could not write recording %s\n", capture->path);
+
+    free(capture->lzw);
+    free(capture->line);
+    free(capture->pixels);
+    free(capture->ring);
+    memset(capture, 0, sizeof(capture_t));
+}
@@ -0,0 +1,68 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdio.h>
+#include <SDL3/SDL.h>
+
+#include "type_defs.h"
+#include "chip8.h"
+
+#define CAPTURE_RING_SIZE 256       // Frames queued for the writer, a few seconds at 60hz
+#define CAPTURE_FPS 60
+#define CAPTURE_DEFAULT_SCALE 5     // Output pixels per hires pixel, 640x320
+#define CAPTURE_GIF_MAX_CODES 4096  // LZW table size cap from the GIF spec
+
+enum capture_format
+{
+    CAPTURE_Y4M = 0,                // Raw YUV frames, every frame written
+    CAPTURE_GIF,                    // 4 color palette, unchanged frames merged into the previous one's delay
+};
+
+// Framebuffer as the emulator had it, expanded and scaled later on the writer thread
+struct capture_frame
+{
+    uint64_t display[DISPLAY_PLANES][DISPLAY_HEIGHT][DISPLAY_ROW_WORDS];
+    bool hires;
+    uint64_t number;                // Frames pushed before this one, gaps are dropped frames
+};
+
+// Recording of the display to a file. The main loop only copies frames into the ring,
+// a writer thread does all encoding and file IO
+struct capture
+{
+    FILE *file;
+    const char *path;
+    capture_format_t format;
+    uint32_t scale;                 // Output pixels per hires pixel, lores pixels get twice that
+    uint32_t width;                 // Output size, always the hires size so resolution switches fit
+    uint32_t height;
+    uint32_t palette[4];            // RGBA8888 indexed by plane bits, like fade.c
+
+    // Single producer single consumer ring, each index only written by its own side
+    capture_frame_t *ring;          // CAPTURE_RING_SIZE frames
+    SDL_AtomicInt head;             // Next frame the writer encodes
+    SDL_AtomicInt tail;             // Next slot the main loop fills
+    SDL_AtomicInt running;          // Cleared to have the writer drain the ring and exit
+    SDL_Semaphore *ready;           // Signalled per pushed frame, writer sleeps on it
+    SDL_Thread *thread;
+    uint64_t frames;                // Frames pushed
+    uint64_t dropped;               // Frames lost to a full ring, main loop never waits
+
+    // Writer thread only
+    uint8_t *pixels;                // Palette indices of the last expanded and scaled frame
+    uint8_t *line;                  // One output row
+    bool failed;                    // Write error, rest of the frames discarded
+    uint64_t next_number;           // Frame number the writer expects next
+    uint8_t yuv[4][3];              // Y4M: palette as Y, Cb, Cr
+    bool subsample;                 // Y4M: 4:2:0, lossless when every 2x2 block is inside one pixel
+    capture_frame_t last;           // GIF: frame pixels holds, written once a different one arrives
+    bool pending;                   // GIF: last not written yet
+    uint64_t written_cs;            // GIF: frame delays written so far, in 1/100s
+    uint16_t (*lzw)[4];             // GIF: LZW code table as a trie, child code per next index
+};
+
+bool init_capture(capture_t *capture, const config_t *config, const char *path, uint32_t scale);
+bool capture_push(capture_t *capture, const chip8_t *chip8);
+void destroy_capture(capture_t *capture);
+
+#endif
@@ -1,9 +1,34 @@
+#include <string.h>
+
 #include "chip8.h"
 #include "app.h"
-#include "sdl.h"
 #include "instruction_tables.h"
+#include "stats.h"
+#include "exec_trace.h"
 
-bool init_chip8(chip8_t *chip8, const config_t *config, const char rom_name[])
+// splitmix64 of the seed, any seed (even 0) gives a usable nonzero xorshift state
+static uint64_t seed_random(uint64_t seed)
+{
+    uint64_t z = seed + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    z ^= z >> 31;
+    return z ? z : 0x9E3779B97F4A7C15ull;
+}
+
+// xorshift64*, top byte of the scrambled output
+static uint8_t next_random(chip8_t *chip8)
+{
+    uint64_t x = chip8->rng;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    chip8->rng = x;
+    return (uint8_t)((x * 0x2545F4914F6CDD1Dull) >> 56);
+}
+
+// Reset machine and load rom image from memory
+bool chip8_load_rom(chip8_t *chip8, const config_t *config, const uint8_t *rom, size_t rom_size)
 {
     const uint32_t entry_point = 0x200; // Chip8 roms will be loaded to 0x200
     const uint8_t font[] = {
@@ -24,418 +49,314 @@ bool init_chip8(chip8_t *chip8, const config_t *config, const char rom_name[])
         0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
         0xF0, 0x80, 0xF0, 0x80, 0x80  // F
     };
+    const size_t max_size = sizeof(chip8->ram) - entry_point;
+
+    if (rom_size > max_size)
+    {
+        fprintf(stderr, "Rom is too big ! Rom size %zu, Max size allowed: %zu\n", rom_size, max_size);
+        return false;
+    }
+
+#ifdef CHIP8_STATS
+    chip8_stats_t *stats = chip8->stats; // Counters outlive resets
+#endif
+    breakpoints_t *breakpoints = chip8->breakpoints; // So do a debugger's breakpoints
+    trace_t *trace = chip8->trace; // And the execution trace
 
     // Initialize entire CHIP8 machine
     memset(chip8, 0, sizeof(chip8_t));
 
-    // Load font
+#ifdef CHIP8_STATS
+    chip8->stats = stats;
+#endif
+    chip8->breakpoints = breakpoints;
+    chip8->trace = trace;
+
+    // Load font and rom
     memcpy(&chip8->ram[0], font, sizeof(font));
+    memcpy(&chip8->ram[entry_point], rom, rom_size);
+
+    // Set Chip8
+    chip8->state = RUNNING;            // Default state
+    chip8->PC = (uint16_t)entry_point; // Start program at entry point
+    chip8->stack_ptr = &chip8->stack[0];
+    chip8->rng = seed_random(config->seed);
+    chip8->wait_key = 0xFF;            // Not waiting on FX0A
+    chip8->planes = 1;                 // Draw to the first bitplane only
+    chip8->handlers = &handler_tables[config->current_extension < NUM_EXTENSIONS ? config->current_extension : CHIP8];
+    chip8->written_hi = sizeof(chip8->ram); // Whole ram is new code for the JIT
+    for (uint32_t i = 0; i < DISPLAY_WIDTH * DISPLAY_HEIGHT; i++)
+        chip8->pixel_color[i] = config->background_color; // Init pixels to background color
+    chip8->dirty_rows = ~0ull; // Draw whole screen first frame
+
+    return true;
+}
+
+// Reset machine and load rom from file
+bool init_chip8(chip8_t *chip8, const config_t *config, const char rom_name[])
+{
+    uint8_t rom_data[4096];
 
     // Open ROM
     FILE *rom = fopen(rom_name, "rb");
     if (!rom)
     {
-        SDL_Log("Rom file %s is invalid or does not exist !\n", rom_name);
+        fprintf(stderr, "Rom file %s is invalid or does not exist !\n", rom_name);
         return false;
     }
 
-    // Get/check rom size
-    fseek(rom, 0, SEEK_END);
-    const size_t rom_size = ftell(rom);
-    const size_t max_size = sizeof(chip8->ram) - entry_point;
-    rewind(rom);
-
-    if (rom_size > max_size)
+    // Read whole rom, anything past ram size is rejected by chip8_load_rom
+    const size_t rom_size = fread(rom_data, 1, sizeof(rom_data), rom);
+    if (ferror(rom))
     {
-        SDL_Log("Rom file %s is too big ! Rom size %zu, Max size allowed: %zu\n", rom_name, rom_size, max_size);
+        fprintf(stderr, "Could not read Rom file %s into CHIP8 memory !\n", rom_name);
+        fclose(rom);
         return false;
     }
 
-    if (fread(&chip8->ram[entry_point], rom_size, 1, rom) != 1)
+    fclose(rom);
+
+    if (!chip8_load_rom(chip8, config, rom_data, rom_size))
     {
-        SDL_Log("Could not read Rom file %s into CHIP8 memory !\n", rom_name);
+        fprintf(stderr, "Rom file %s could not be loaded !\n", rom_name);
         return false;
     }
 
-    fclose(rom);
-
-    // Set Chip8
-    chip8->state = RUNNING;            // Default state
-    chip8->PC = (uint16_t)entry_point; // Start program at entry point
     chip8->rom_name = rom_name;
-    chip8->stack_ptr = &chip8->stack[0];
-    memset(&chip8->pixel_color[0], config->background_color, sizeof(chip8->pixel_color)); // Init pixels to background color
 
     return true;
 }
 
-void handle_input(chip8_t *chip8, config_t *config)
+// Decode opcode at PC once and store it in the instruction cache
+static void decode_instruction(chip8_t *chip8, decoded_instruction_t *entry, uint16_t address)
 {
-    SDL_Event event;
+    const uint16_t opcode = (chip8->ram[address] << 8) | chip8->ram[(address + 1) & 0xFFF];
+
+    // Fill out instruction format
+    // DXYN
+    entry->inst.opcode = opcode;
+    entry->inst.NNN = opcode & 0xFFF;
+    entry->inst.NN = opcode & 0x0FF;
+    entry->inst.N = opcode & 0x0F;
+    entry->inst.X = (opcode >> 8) & 0x0F;
+    entry->inst.Y = (opcode >> 4) & 0x0F;
+    entry->handler = decode_opcode(chip8->handlers, opcode);
+}
+
+// Run one decoded instruction and record it in the trace ring
+static void trace_instruction(chip8_t *chip8, const config_t *config, const decoded_instruction_t *entry,
+                              uint16_t address)
+{
+    trace_record_t *record = trace_begin(chip8->trace, chip8, address, &entry->inst, 0, 0);
+    entry->handler(chip8, config);
+    trace_end(chip8->trace, record, chip8, entry->inst.X);
+}
+
+// Emulate 1 instruction
+void emulate_instruction(chip8_t *chip8, const config_t *config)
+{
+    // Get next instruction from cache, decode it first time PC lands here
+    const uint16_t address = chip8->PC & 0xFFF;
+    decoded_instruction_t *entry = &chip8->icache[address];
+    if (!entry->handler)
+        decode_instruction(chip8, entry, address);
+
+    chip8->inst = entry->inst;
+    chip8->PC += 2; // Pre increment program counter for next opcode
+
+    STATS_INC(chip8, opcode_count[opcode_class(entry->handler, entry->inst.opcode)]);
+    STATS_INC(chip8, pc_count[address]);
+
+    // Emulate opcode, recording it when tracing
+    if (chip8->trace)
+        trace_instruction(chip8, config, entry, address);
+    else
+        entry->handler(chip8, config);
+}
+
+// Emulate 1 instruction the plain way, fetched from ram and dispatched through opcode_table every time.
+// No instruction cache, this is the reference the cached and JIT engines are verified against
+void emulate_instruction_reference(chip8_t *chip8, const config_t *config)
+{
+    const uint16_t address = chip8->PC & 0xFFF;
+    const uint16_t opcode = (chip8->ram[address] << 8) | chip8->ram[(address + 1) & 0xFFF];
+
+    chip8->inst.opcode = opcode;
+    chip8->inst.NNN = opcode & 0xFFF;
+    chip8->inst.NN = opcode & 0x0FF;
+    chip8->inst.N = opcode & 0x0F;
+    chip8->inst.X = (opcode >> 8) & 0x0F;
+    chip8->inst.Y = (opcode >> 4) & 0x0F;
+    chip8->PC += 2;
+
+    chip8->handlers->opcode_table[(opcode >> 12) & 0x0F](chip8, config);
+}
 
-    while (SDL_PollEvent(&event))
+// Drop cached instructions overlapping written ram so self modifying roms still work
+void invalidate_icache(chip8_t *chip8, uint16_t address, uint16_t length)
+{
+    // Instruction starting one byte before the write also contains a written byte
+    for (uint16_t i = 0; i <= length; i++)
+        chip8->icache[(address - 1 + i) & 0xFFF].handler = NULL;
+
+    // Remember written range so the JIT can drop translated blocks too
+    if (address < chip8->written_lo)
+        chip8->written_lo = address;
+    const uint32_t end = (uint32_t)address + length;
+    if (end > chip8->written_hi)
+        chip8->written_hi = end > 0xFFFF ? 0xFFFF : (uint16_t)end;
+
+    // Every ram store comes through here, so it doubles as the write watchpoint check
+    breakpoints_t *breakpoints = chip8->breakpoints;
+    if (breakpoints && breakpoints->num_write && !breakpoints->watch_hit)
     {
-        switch (event.type)
+        for (uint16_t i = 0; i < length; i++)
         {
-        case SDL_EVENT_QUIT:
-            chip8->state = QUIT; // Will exit main emulator loop
-            return;
-
-        case SDL_EVENT_KEY_DOWN:
-            switch (event.key.key)
+            if (breakpoint_test(breakpoints->write, (uint16_t)(address + i)))
             {
-            case SDLK_ESCAPE:
-                chip8->state = QUIT; // Exit window
-                break;
-            case SDLK_SPACE:
-                if (chip8->state == RUNNING)
-                {
-                    chip8->state = PAUSED; // Pause
-                    puts("======= PAUSED =======");
-                }
-                else
-                    chip8->state = RUNNING; // Resume
-                break;
-            case SDLK_ASTERISK:
-                // '*': Reset CHIP8 machine for current rom
-                init_chip8(chip8, config, chip8->rom_name);
-                break;
-            case SDLK_J:
-                // 'J': Decrease color lerp rate
-                if(config->color_lerp_rate > 0.1)
-                    config->color_lerp_rate -= 0.1f;
-                break;
-            case SDLK_K:
-                // 'K': Increase color lerp rate
-                if(config->color_lerp_rate < 0.9)
-                    config->color_lerp_rate += 0.1f;
-                break;
-            case SDLK_O:
-                // 'O': Decrease volume
-                if(config->volume > 0)
-                    config->volume -= 500;
-                break;
-            case SDLK_P:
-                // 'P': Increase volume
-                if(config->volume < INT16_MAX)
-                    config->volume += 500;
-                break;
-            default:
+                breakpoints->hit = true;
+                breakpoints->watch_hit = true;
+                breakpoints->watch_address = (address + i) & 0xFFF;
                 break;
             }
-            for (int i = 0; i < NUM_KEYS; i++) {
-                if (event.key.key == KEYMAP[i][0]) {
-                    chip8->keypad[KEYMAP[i][1]] = true;
-                }
-            }
-            break;
-
-        case SDL_EVENT_KEY_UP:
-            for (int i = 0; i < NUM_KEYS; i++) {
-                if (event.key.key == KEYMAP[i][0]) {
-                    chip8->keypad[KEYMAP[i][1]] = false;
-                }
-            }
-            break;
-        default:
-            break;
         }
     }
 }
 
-// TODO: Not sure this is the right way or it works correctly check later
-void handle_audio(chip8_t *chip8, const config_t *config, SDL_AudioStream *stream)
+// Decrement delay and sound timers, call at 60hz
+void chip8_tick_timers(chip8_t *chip8)
 {
-    // Calculate number of samples to generate based on your audio format
-    int num_samples = config->audio_sample_rate / 75; // generate ~20ms of audio per callback
-    int16_t *temp_buffer = malloc(num_samples * sizeof(int16_t));
-    if (!temp_buffer) return;
-
-    static uint32_t running_sample_index = 0;
-    const int32_t square_wave_period = config->audio_sample_rate / config->square_wave_freq;
-    const int32_t half_square_wave_period = square_wave_period / 2;
-
-    if (chip8->sound_timer == 0) {
-        memset(temp_buffer, 0, num_samples * sizeof(int16_t));
-    } else {
-        for (int i = 0; i < num_samples; i++) {
-            temp_buffer[i] = ((running_sample_index++ / half_square_wave_period) % 2)
-                                ?  config->volume
-                                : -config->volume;
+    if(chip8->delay_timer > 0) chip8->delay_timer--;
+    if(chip8->sound_timer > 0) chip8->sound_timer--;
+}
+
+// chip8_step with breakpoints armed, stops before a breakpoint's instruction or after a watched write
+static uint32_t step_breakpoints(chip8_t *chip8, const config_t *config, uint32_t num_insts)
+{
+    breakpoints_t *breakpoints = chip8->breakpoints;
+    for (uint32_t i = 0; i < num_insts; i++)
+    {
+        if (breakpoints->hit || breakpoint_test(breakpoints->exec, chip8->PC))
+        {
+            breakpoints->hit = true;
+            return i;
         }
+        emulate_instruction(chip8, config);
+        if (chip8->idle && config->skip_idle)
+            return i + 1;
     }
-    // Push the generated samples into the SDL_AudioStream
-    SDL_PutAudioStreamData(stream, temp_buffer, num_samples * sizeof(int16_t));
 
-    free(temp_buffer);
+    return num_insts;
 }
 
-#ifdef DEBUG
-void print_debug_info(chip8_t *chip8)
+// Emulate up to num_insts instructions, returns number of instructions executed.
+// Stops early once the rom idles, nothing changes until the next timer tick or key event
+uint32_t chip8_step(chip8_t *chip8, const config_t *config, uint32_t num_insts)
 {
-    printf("Address: 0x%04X, Opcode: 0x%04X Description: ", chip8->PC - 2, chip8->inst.opcode);
-    
-    switch ((chip8->inst.opcode >> 12) & 0x0F)
+    chip8->idle = false;
+    if (chip8->breakpoints)
+        return step_breakpoints(chip8, config, num_insts);
+
+    // Copied out, handlers are called through pointers so the compiler can't hoist it
+    const bool skip_idle = config->skip_idle;
+    for (uint32_t i = 0; i < num_insts; i++)
     {
-        case 0x0:
-            if (chip8->inst.NN == 0xE0)
-            {
-                // 0x00E0: Clear the screen
-                printf("Clear screen\n");
-            }
-            else if (chip8->inst.NN == 0xEE)
-            {
-                // 0x00EE: return from subroutine
-                // Set program counter to last address on subroutine stack (pop)
-                // so that the next opcode value is used from there
-                printf("Return from subroutine to address 0x%04X\n", *(chip8->stack_ptr - 1));
-            }
-            break;
-        case 0x01:
-            // 0x1NNN: Jumps to address NNN
-            printf("Jump to address NNN (0x%04X)\n", chip8->inst.NNN);
-            break;
-        case 0x02:
-            // 0x2NNN: Call subroutine at NNN
-            // Store current address return to subroutine stack (push)
-            // Set program counter to subroutine address so that the next opcode value is used from there
-            printf("Call subroutine at NNN (0x%04X)\n", chip8->inst.NNN);
-            break;
-        case 0x03:
-            // 0x3XNN: Skip next instruction if VX equals NN
-            printf("Check if V%X (0x%02X) == NN (0x%02X), skip next instruction if true\n", chip8->inst.X,
-                                                                                        chip8->V[chip8->inst.X], chip8->inst.NN);
-            break;
-        case 0x04:
-            // 0x4XNN: Skip next instruction if VX is not equal to NN
-            printf("Check if V%X (0x%02X) != NN (0x%02X), skip next instruction if true\n", chip8->inst.X,
-                                                                                        chip8->V[chip8->inst.X], chip8->inst.NN);
-            break;
-        case 0x05: 
-            if(chip8->inst.N != 0)
-                break;
-            // 0x5XY0: Check if VX equals VY if so, skip the next instruction
-            printf("Check if V%X (0x%02X) == V%X (0x%02X), skip next instruction if true\n", chip8->inst.X, chip8->V[chip8->inst.X],
-                                                                                             chip8->inst.Y, chip8->V[chip8->inst.Y]);
-            break;
-        case 0x06: 
-            // 0x6XNN: Set register VX to NN
-            printf("Set register V%X = NN (0x%02X)\n", chip8->inst.X, chip8->inst.NN);
-            break;
-        case 0x07:
-            // 0x7XNN: Set register VX += NN
-            printf("Set register V%X (0x%02X) += NN (0x%02X). Result: 0x%02X\n", chip8->inst.X, 
-                                                                chip8->V[chip8->inst.X], chip8->inst.NN, 
-                                                                chip8->V[chip8->inst.X] + chip8->inst.NN);
-            break;
-    case 0x08:
-        switch(chip8->inst.N) {
-            case 0:
-                // 0x8XY0: Set VX to the value of VY
-                printf("Set register V%X = V%X (0x%02X)\n", chip8->inst.X, 
-                                                            chip8->inst.Y, chip8->V[chip8->inst.Y]);
-                break;
-            case 1:
-                // 0x8XY1: Sets VX to VX or VY. (bitwise OR operation)
-                printf("Set register V%X (0x%02X) |= V%X (0x%02X); Result: 0x%02X\n", 
-                                                            chip8->inst.X, chip8->V[chip8->inst.X],
-                                                            chip8->inst.Y, chip8->V[chip8->inst.Y],
-                                                            chip8->V[chip8->inst.X] | chip8->V[chip8->inst.Y]);
-                break;
-            case 2:
-                // 0x8XY2: Sets VX to VX and VY. (bitwise AND operation)
-                printf("Set register V%X (0x%02X) &= V%X (0x%02X); Result: 0x%02X\n", 
-                                                            chip8->inst.X, chip8->V[chip8->inst.X] ,
-                                                            chip8->inst.Y, chip8->V[chip8->inst.Y],
-                                                            chip8->V[chip8->inst.X] & chip8->V[chip8->inst.Y]);
-                break;
-            case 3:
-                // 0x8XY3: Sets VX to VX xor VY.
-                printf("Set register V%X (0x%02X) ^= V%X (0x%02X); Result: 0x%02X\n", 
-                                                            chip8->inst.X, chip8->V[chip8->inst.X], 
-                                                            chip8->inst.Y, chip8->V[chip8->inst.Y],
-                                                            chip8->V[chip8->inst.X] ^ chip8->V[chip8->inst.Y]);
-                break;
-            case 4:
-                // 0x8XY4: Adds VY to VX. VF is set to 1 when there's an overflow, and to 0 when there is not.
-                printf("Set register V%X (0x%02X) += V%X (0x%02X); VF = 1 if carry; Result: 0x%02X VF=%X\n", 
-                                                            chip8->inst.X, chip8->V[chip8->inst.X], 
-                                                            chip8->inst.Y, chip8->V[chip8->inst.Y],
-                                                            chip8->V[chip8->inst.X] + chip8->V[chip8->inst.Y],
-                                                            (uint16_t)(chip8->V[chip8->inst.X] + chip8->V[chip8->inst.Y]) > 255);
-            case 5:
-                // 0x8XY5: VY is subtracted from VX. VF is set to 0 when there's an underflow, and 1 when there is not. (i.e. VF set to 1 if VX >= VY and 0 if not)
-                printf("Set register V%X (0x%02X) -= V%X (0x%02X); VF = 1 if no borrow; Result: 0x%02X VF=%X\n", 
-                                                            chip8->inst.X, chip8->V[chip8->inst.X], 
-                                                            chip8->inst.Y, chip8->V[chip8->inst.Y],
-                                                            chip8->V[chip8->inst.X] + chip8->V[chip8->inst.Y],
-                                                            chip8->V[chip8->inst.Y] <= chip8->V[chip8->inst.X]);
-                break;
-            case 6:
-                // 0x8XY6: Shifts VX to the right by 1, then stores the least significant bit of VX prior to the shift into VF.
-                printf("Set register V%X (0x%02X) >>=1  VF = shifted off bit (%X); Result: 0x%02X \n", 
-                                                            chip8->inst.X, chip8->V[chip8->inst.X], 
-                                                            chip8->V[chip8->inst.X] & 1,
-                                                            chip8->V[chip8->inst.X] >> 1);
-                break;
-            case 7:
-                // 0x8XY7: VX is subtracted from VY. VF is set to 0 when there's an underflow, and 1 when there is not. (i.e. VF set to 1 if VY >= VX and 0 if not)
-                printf("Set register V%X (0x%02X) -= V%X (0x%02X); VF = 1 if no borrow; Result: 0x%02X VF=%X\n", 
-                                                            chip8->inst.Y, chip8->V[chip8->inst.Y], 
-                                                            chip8->inst.X, chip8->V[chip8->inst.X],
-                                                            chip8->V[chip8->inst.Y] + chip8->V[chip8->inst.X],
-                                                            chip8->V[chip8->inst.X] <= chip8->V[chip8->inst.Y]);
-                break;
-            case 0XE:
-                // 0x8XYE: Shifts VX to the left by 1, then sets VF to 1 if the most significant bit of VX prior to that shift was set, or to 0 if it was unset.
-                printf("Set register V%X (0x%02X) <<=1  VF = shifted off bit (%X); Result: 0x%02X \n", 
-                                                            chip8->inst.X, chip8->V[chip8->inst.X], 
-                                                            chip8->V[chip8->inst.X] & 80 >> 7,
-                                                            chip8->V[chip8->inst.X] << 1);
-                break;
-            default:
-                break; // Unimplemented or invalid opcode
-        }
-        case 0x09:
-            // 0x9XY0: Skips the next instruction if VX does not equal VY. (Usually the next instruction is a jump to skip a code block).
-            printf("Check if V%X (0x%02X) != V%X (0x%02X), skip next instruction if true\n", chip8->inst.X, chip8->V[chip8->inst.X],
-                                                                                             chip8->inst.Y, chip8->V[chip8->inst.Y]);
-            break;
-        case 0x0A:
-            // 0xANNN: Set index register I to NNN
-            printf("Set I to NNN (0x%04X)\n", chip8->inst.NNN);
-            break;
-        case 0x0B:
-            // 0xBNNN: Jumps to the address NNN plus V0
-            printf("Set PC to V0 (0x%02X) + NNN (0x%04x); Result PC = 0x%04X\n", chip8->V[0], chip8->inst.NNN,
-                                                             chip8->inst.NNN + chip8->V[0]);
-            break;
-        case 0x0C:
-            // 0xCNNN: Set Vx = rand() & NN. rand() creates a number between 0-255 
-            printf("Set V%X = rand() %% 256 & NN (0x%02X)\n", chip8->inst.X, chip8->inst.NN);
-            break;
-        case 0x0D:
-        // 0x0DXYN: Draw N height sprite at coordinates X, Y; Read from memory location I
-        // Screen pixels are XOR'd with sprite bits
-        // VF (Carry flag) is set if any screen pixels are set off; This is useful
-        // for collision detection or other reasons.
-            printf("Draw N (%d) height sprite at coords V%X (0x%02X), V%X (0x%02X)"
-                 "from memory location I (0x%04X). Set VF = 1 if any pixels are turned off.\n", 
-                chip8->inst.N, chip8->inst.X, chip8->V[chip8->inst.X], chip8->inst.Y, 
-                chip8->V[chip8->inst.Y], chip8->I);
-            break;
-        case 0x0E: 
-            if(chip8->inst.NN == 0x9E) {
-                // 0xEX9E: Skip next instruction if key in VX is pressed
-                printf("Skip next instruction if key in V%X (0x%02X) is pressed, Keypad value %d\n",
-                                                                                                chip8->inst.X, chip8->V[chip8->inst.X],
-                                                                                                chip8->keypad[chip8->V[chip8->inst.X]]);
-            } else if(chip8->inst.NN == 0xA1) {
-                // 0xEX9E: Skip next instruction if key in VX is not pressed
-                printf("Skip next instruction if key in V%X (0x%02X) is not pressed, Keypad value %d\n",
-                                                                                                chip8->inst.X, chip8->V[chip8->inst.X],
-                                                                                                chip8->keypad[chip8->V[chip8->inst.X]]);
-            }
-            break;
-        case 0x0F:
-            switch (chip8->inst.NN) {
-            case 0x0A:
-                // 0xFX0A: A key press is awaited, and then stored in VX (blocking operation, all instruction halted until next key event, delay and sound timers should continue processing).
-                printf("Await until a key is pressed; Store key in V%X\n", chip8->inst.X);
-                break;
-            case 0x1E:
-                // 0xFX1E: Adds VX to I. VF is not affected. For non-Amiga CHIP8, does not affect VF
-                printf("I (0x%04X) += V%X (0x%02X); Result (I): 0x%04X\n", chip8->I, chip8->inst.X, 
-                                                                           chip8->V[chip8->inst.X], chip8->I + chip8->V[chip8->inst.X]);
-                break;
-            case 0x07:
-                // 0xFX07: VX = delay timer
-                printf("Set V%X = delay timer value (0x%02X)\n", chip8->inst.X, chip8->delay_timer);
-                break;
-            case 0x15:
-                // 0xFX15: delay timer = VX
-                printf("Set delay timer value = V%X (0x%02X)\n", chip8->inst.X, chip8->V[chip8->inst.X]);
-                break;
-            case 0x18:
-                // 0xFX18: VX = sonud timer
-                printf("Set V%X = sound timer value (0x%02X)\n", chip8->inst.X, chip8->sound_timer);
-                break;
-            case 0x29:
-                // 0xF29: Set register I to sprite location in memory for character in VX (0x0 - 0xF)
-                printf("Set I to sprite location in memory for character in V%X (0x%02X). Result(VX*5) = (0x%02X)\n", 
-                                                                                            chip8->inst.X, chip8->V[chip8->inst.X],
-                                                                                            chip8->V[chip8->inst.X] * 5);
-                break;
-            case 0x33:
-                // 0xFX33: Store BCD representation of VX at memory offset from I
-                // I = hundred's place, I+1 = ten's place, I+2 = one's place;
-                printf("Store BCD representation of V%X (0x%02X) at memory from I (0x%04X)\n", chip8->inst.X,
-                                                                                            chip8->V[chip8->inst.X], chip8->I);
-                break;
-            case 0x55:
-                // 0xFX55: Register dump V0-VX inclusive to memory offset from I;
-                // SCHIP does not increment I, CHIP8 does increment I;
-                printf("Register dump  V0-V%X (0x%02X) inclusive at memory from I (0x%04X)\n", chip8->inst.X,
-                                                                                            chip8->V[chip8->inst.X], chip8->I);
-                break;
-            case 0x65:
-                // 0xFX65: Register load V0-VX inclusive to memory offset from I;
-                // SCHIP does not increment I, CHIP8 does increment I;
-                printf("Register load  V0-V%X (0x%02X) inclusive at memory from I (0x%04X)\n", chip8->inst.X,
-                                                                                            chip8->V[chip8->inst.X], chip8->I);
-                break;
-            default:
-                break;
-            }
-            break;
-        default:
-            printf("Unimplemented or invalid opcode !\n");
-            break; // Unimplemented or invalid opcode
+        emulate_instruction(chip8, config);
+        if (chip8->idle && skip_idle)
+            return i + 1;
     }
+
+    return num_insts;
 }
-#endif
 
-// Emulate 1 instruction
-void emulate_instruction(chip8_t *chip8, const config_t *config)
+// Would a 1NNN at address jumping to target only burn time until the next timer tick?
+// Matches a jump to itself and the FX07, 3XNN/4XNN, 1NNN delay timer poll
+bool chip8_idle_jump(const chip8_t *chip8, uint16_t address, uint16_t target)
 {
-    // Get next opcode from ram
-    chip8->inst.opcode = (chip8->ram[chip8->PC] << 8) | chip8->ram[chip8->PC + 1];
-    chip8->PC += 2; // Pre increment program counter for next opcode
+    if (target == address)
+        return true;
+    if (target + 4u != address)
+        return false;
 
-    // Fill out current instruction format
-    // DXYN
-    chip8->inst.NNN = chip8->inst.opcode & 0xFFF;
-    chip8->inst.NN = chip8->inst.opcode & 0x0FF;
-    chip8->inst.N = chip8->inst.opcode & 0x0F;
-    chip8->inst.X = (chip8->inst.opcode >> 8) & 0x0F;
-    chip8->inst.Y = (chip8->inst.opcode >> 4) & 0x0F;
-
-#ifdef DEBUG
-    print_debug_info(chip8);
-#endif
+    const uint16_t read = (chip8->ram[target] << 8) | chip8->ram[target + 1];
+    const uint16_t test = (chip8->ram[target + 2] << 8) | chip8->ram[target + 3];
+    return (read & 0xF0FF) == 0xF007 &&
+           ((test & 0xF000) == 0x3000 || (test & 0xF000) == 0x4000) &&
+           ((test >> 8) & 0x0F) == ((read >> 8) & 0x0F);
+}
 
-    // Emulate opcode
-    // Dispatch using high nibble
-    uint8_t high_nibble = (chip8->inst.opcode >> 12) & 0x0F;
-    opcode_table[high_nibble](chip8, config);
+// Set CHIP8 keypad key 0x0 - 0xF pressed/released
+void chip8_set_key(chip8_t *chip8, uint8_t key, bool pressed)
+{
+    chip8->keypad[key & 0xF] = pressed;
 }
 
-void update_timers(const sdl_t *sdl, chip8_t *chip8) {
-    if(chip8->delay_timer > 0) chip8->delay_timer--;
-    if(chip8->sound_timer > 0) {
-        chip8->sound_timer--;
-        SDL_PauseAudioStreamDevice(sdl->stream);
-    }
-    else {
-        SDL_ResumeAudioStreamDevice(sdl->stream);
+// Display rows, DISPLAY_ROW_WORDS 64 bit words per row, leftmost pixel in the most significant bit.
+// DISPLAY_HEIGHT rows of the first plane, the other planes follow
+const uint64_t *chip8_framebuffer(const chip8_t *chip8)
+{
+    return &chip8->display[0][0][0];
+}
+
+// Single display pixel on/off in the first plane
+bool chip8_get_pixel(const chip8_t *chip8, uint32_t x, uint32_t y)
+{
+    return (chip8->display[0][y][x / 64] >> (63 - x % 64)) & 1;
+}
+
+// Rows of the active resolution, bit per row like dirty_rows
+static uint64_t active_rows(const chip8_t *chip8)
+{
+    const uint32_t height = chip8_display_height(chip8);
+    return height >= 64 ? ~0ull : (1ull << height) - 1;
+}
+
+// Columns of the active resolution in row word w
+static uint64_t active_columns(const chip8_t *chip8, uint32_t w)
+{
+    return w * 64 < chip8_display_width(chip8) ? ~0ull : 0;
+}
+
+// Switch resolution, lores lives in the top left of the display so both planes start out clear
+static void set_resolution(chip8_t *chip8, bool hires)
+{
+    chip8->hires = hires;
+    memset(chip8->display, 0, sizeof(chip8->display));
+    chip8->dirty_rows = ~0ull;
+    chip8->draw = true;
+}
+
+// Quirk handlers are written once against an extension and get one copy per extension,
+// each handler table points at its own copy so the quirk checks fold away at compile time
+#define EXTENSION_VARIANTS(name)                                                \
+    void name##_CHIP8(chip8_t *chip8, const config_t *config)                   \
+    {                                                                           \
+        (void)config;                                                           \
+        name##_quirks(chip8, CHIP8);                                            \
+    }                                                                           \
+    void name##_SUPERCHIP(chip8_t *chip8, const config_t *config)               \
+    {                                                                           \
+        (void)config;                                                           \
+        name##_quirks(chip8, SUPERCHIP);                                        \
+    }                                                                           \
+    void name##_X0CHIP(chip8_t *chip8, const config_t *config)                  \
+    {                                                                           \
+        (void)config;                                                           \
+        name##_quirks(chip8, X0CHIP);                                           \
     }
+
+void instr_NOP(chip8_t *chip8, const config_t *config) {
+    (void)chip8;
+    (void)config;
+
+    // Unimplemented / invalid opcode
 }
 
 void instr_0NNN(chip8_t *chip8, const config_t *config) {
     (void)config;
 
-    if (table_0NNN[chip8->inst.NN])
-        table_0NNN[chip8->inst.NN](chip8, config);
+    if (chip8->handlers->table_0NNN[chip8->inst.NN])
+        chip8->handlers->table_0NNN[chip8->inst.NN](chip8, config);
     else{
         // Unimplemented / invalid opcode maybe NNN
     }
@@ -444,8 +365,22 @@ void instr_0NNN(chip8_t *chip8, const config_t *config) {
 void instr_00E0(chip8_t *chip8, const config_t *config) {
     (void)config;
 
-    // 0x00E0: Clear the screen
-    memset(&chip8->display[0], false, sizeof(chip8->display));
+    // 0x00E0: Clear the screen, selected planes only
+    for (uint32_t p = 0; p < DISPLAY_PLANES; p++)
+    {
+        if (!(chip8->planes & (1u << p)))
+            continue;
+
+        for (uint32_t y = 0; y < DISPLAY_HEIGHT; y++)
+        {
+            for (uint32_t w = 0; w < DISPLAY_ROW_WORDS; w++)
+            {
+                if (chip8->display[p][y][w])
+                    chip8->dirty_rows |= 1ull << y; // Only lit rows change
+                chip8->display[p][y][w] = 0;
+            }
+        }
+    }
     chip8->draw = true; // Will update screen on next 60hz tick
 }
 
@@ -458,10 +393,110 @@ void instr_00EE(chip8_t *chip8, const config_t *config) {
     chip8->PC = *--chip8->stack_ptr;
 }
 
+void instr_00CN(chip8_t *chip8, const config_t *config) {
+    (void)config;
+
+    // 0x00CN: Scroll selected planes down N pixels, whole rows moved at once
+    const uint32_t height = chip8_display_height(chip8);
+    const uint32_t n = chip8->inst.N;
+    for (uint32_t p = 0; p < DISPLAY_PLANES; p++)
+    {
+        if (!(chip8->planes & (1u << p)))
+            continue;
+        memmove(&chip8->display[p][n], &chip8->display[p][0], (height - n) * sizeof(chip8->display[p][0]));
+        memset(&chip8->display[p][0], 0, n * sizeof(chip8->display[p][0]));
+    }
+    chip8->dirty_rows |= active_rows(chip8);
+    chip8->draw = true;
+}
+
+void instr_00DN(chip8_t *chip8, const config_t *config) {
+    (void)config;
+
+    // 0x00DN: XO-CHIP scroll selected planes up N pixels
+    const uint32_t height = chip8_display_height(chip8);
+    const uint32_t n = chip8->inst.N;
+    for (uint32_t p = 0; p < DISPLAY_PLANES; p++)
+    {
+        if (!(chip8->planes & (1u << p)))
+            continue;
+        memmove(&chip8->display[p][0], &chip8->display[p][n], (height - n) * sizeof(chip8->display[p][0]));
+        memset(&chip8->display[p][height - n], 0, n * sizeof(chip8->display[p][0]));
+    }
+    chip8->dirty_rows |= active_rows(chip8);
+    chip8->draw = true;
+}
+
+void instr_00FB(chip8_t *chip8, const config_t *config) {
+    (void)config;
+
+    // 0x00FB: Scroll selected planes right 4 pixels, bits carried from word to word
+    const uint32_t height = chip8_display_height(chip8);
+    for (uint32_t p = 0; p < DISPLAY_PLANES; p++)
+    {
+        if (!(chip8->planes & (1u << p)))
+            continue;
+        for (uint32_t y = 0; y < height; y++)
+        {
+            uint64_t *row = chip8->display[p][y];
+            for (uint32_t w = DISPLAY_ROW_WORDS - 1; w > 0; w--)
+                row[w] = ((row[w] >> 4) | (row[w - 1] << 60)) & active_columns(chip8, w);
+            row[0] >>= 4;
+        }
+    }
+    chip8->dirty_rows |= active_rows(chip8);
+    chip8->draw = true;
+}
+
+void instr_00FC(chip8_t *chip8, const config_t *config) {
+    (void)config;
+
+    // 0x00FC: Scroll selected planes left 4 pixels
+    const uint32_t height = chip8_display_height(chip8);
+    for (uint32_t p = 0; p < DISPLAY_PLANES; p++)
+    {
+        if (!(chip8->planes & (1u << p)))
+            continue;
+        for (uint32_t y = 0; y < height; y++)
+        {
+            uint64_t *row = chip8->display[p][y];
+            for (uint32_t w = 0; w + 1 < DISPLAY_ROW_WORDS; w++)
+                row[w] = (row[w] << 4) | (row[w + 1] >> 60);
+            row[DISPLAY_ROW_WORDS - 1] <<= 4;
+        }
+    }
+    chip8->dirty_rows |= active_rows(chip8);
+    chip8->draw = true;
+}
+
+void instr_00FD(chip8_t *chip8, const config_t *config) {
+    (void)config;
+
+    // 0x00FD: Exit interpreter, halt here for good
+    chip8->PC -= 2;
+    chip8->idle = true;
+}
+
+void instr_00FE(chip8_t *chip8, const config_t *config) {
+    (void)config;
+
+    // 0x00FE: 64x32 lores mode
+    set_resolution(chip8, false);
+}
+
+void instr_00FF(chip8_t *chip8, const config_t *config) {
+    (void)config;
+
+    // 0x00FF: 128x64 hires mode
+    set_resolution(chip8, true);
+}
+
 void instr_1NNN(chip8_t *chip8, const config_t *config) {
     (void)config;
 
     // 0x1NNN: Jumps to address NNN
+    if (chip8_idle_jump(chip8, chip8->PC - 2, chip8->inst.NNN))
+        chip8->idle = true; // Busy wait, skip to the next timer tick
     chip8->PC = chip8->inst.NNN; // Set program counter so that next opcode is NNN
 }
 
@@ -518,8 +553,8 @@ void instr_7XNN(chip8_t *chip8, const config_t *config) {
 void instr_8XYN(chip8_t *chip8, const config_t *config) {
     (void)config;
 
-    if(table_8XYN[chip8->inst.N])
-        table_8XYN[chip8->inst.N](chip8, config);
+    if(chip8->handlers->table_8XYN[chip8->inst.N])
+        chip8->handlers->table_8XYN[chip8->inst.N](chip8, config);
 }
 
 void instr_8XY0(chip8_t *chip8, const config_t *config) {
@@ -529,32 +564,29 @@ void instr_8XY0(chip8_t *chip8, const config_t *config) {
     chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y];
 }
 
-void instr_8XY1(chip8_t *chip8, const config_t *config) {
-    (void)config;
-
+static inline void instr_8XY1_quirks(chip8_t *chip8, const extension_t extension) {
     // 0x8XY1: Sets VX to VX or VY. (bitwise OR operation)
     chip8->V[chip8->inst.X] |= chip8->V[chip8->inst.Y];
-    if(config->current_extension == CHIP8)
+    if(extension == CHIP8)
         chip8->V[0xF] = 0; // Chip-8 ONLY QUIRK
 }
+EXTENSION_VARIANTS(instr_8XY1)
 
-void instr_8XY2(chip8_t *chip8, const config_t *config) {
-    (void)config;
-
+static inline void instr_8XY2_quirks(chip8_t *chip8, const extension_t extension) {
     // 0x8XY2: Sets VX to VX and VY. (bitwise AND operation)
     chip8->V[chip8->inst.X] &= chip8->V[chip8->inst.Y];
-    if(config->current_extension == CHIP8)
+    if(extension == CHIP8)
         chip8->V[0xF] = 0; // Chip-8 ONLY QUIRK
 }
+EXTENSION_VARIANTS(instr_8XY2)
 
-void instr_8XY3(chip8_t *chip8, const config_t *config) {
-    (void)config;
-
+static inline void instr_8XY3_quirks(chip8_t *chip8, const extension_t extension) {
     // 0x8XY3: Sets VX to VX xor VY.
     chip8->V[chip8->inst.X] ^= chip8->V[chip8->inst.Y];
-    if(config->current_extension == CHIP8)
+    if(extension == CHIP8)
         chip8->V[0xF] = 0; // Chip-8 ONLY QUIRK
 }
+EXTENSION_VARIANTS(instr_8XY3)
 
 void instr_8XY4(chip8_t *chip8, const config_t *config) {
     (void)config;
@@ -576,12 +608,10 @@ void instr_8XY5(chip8_t *chip8, const config_t *config) {
     chip8->V[0xF] = carry;
 }
 
-void instr_8XY6(chip8_t *chip8, const config_t *config) {
-    (void)config;
-
+static inline void instr_8XY6_quirks(chip8_t *chip8, const extension_t extension) {
     // 0x8XY6: Shifts VX to the right by 1, then stores the least significant bit of VX prior to the shift into VF.
     bool carry;
-    if(config->current_extension == CHIP8) {
+    if(extension == CHIP8) {
         carry = chip8->V[chip8->inst.Y] & 1; // USE VY
         chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y] >> 1;
     }
@@ -593,6 +623,7 @@ void instr_8XY6(chip8_t *chip8, const config_t *config) {
     
     chip8->V[0xF] = carry;
 }
+EXTENSION_VARIANTS(instr_8XY6)
 
 void instr_8XY7(chip8_t *chip8, const config_t *config) {
     (void)config;
@@ -604,12 +635,10 @@ void instr_8XY7(chip8_t *chip8, const config_t *config) {
     chip8->V[0xF] = carry;
 }
 
-void instr_8XYE(chip8_t *chip8, const config_t *config) {
-    (void)config;
-
+static inline void instr_8XYE_quirks(chip8_t *chip8, const extension_t extension) {
     // 0x8XYE: Shifts VX to the left by 1, then sets VF to 1 if the most significant bit of VX prior to that shift was set, or to 0 if it was unset.
     bool carry;
-    if(config->current_extension == CHIP8) {
+    if(extension == CHIP8) {
         carry = (chip8->V[chip8->inst.Y] & 0x80) >> 7;          // Use VY
         chip8->V[chip8->inst.X] = chip8->V[chip8->inst.Y] << 1; // Set VX = VY;
     }
@@ -620,6 +649,7 @@ void instr_8XYE(chip8_t *chip8, const config_t *config) {
 
     chip8->V[0xF] = carry;
 }
+EXTENSION_VARIANTS(instr_8XYE)
 
 void instr_9XY0(chip8_t *chip8, const config_t *config) {
     (void)config;
@@ -648,57 +678,97 @@ void instr_BNNN(chip8_t *chip8, const config_t *config) {
 void instr_CXNN(chip8_t *chip8, const config_t *config) {
     (void)config;
 
-    // 0xCNNN: Set Vx = rand() & NN. rand() creates a number between 0-255
-    chip8->V[chip8->inst.X] = (rand() % 256) & chip8->inst.NN;
+    // 0xCNNN: Set Vx = random byte & NN, from this machine's own generator
+    chip8->V[chip8->inst.X] = next_random(chip8) & chip8->inst.NN;
 }
 
-void instr_DXYN(chip8_t *chip8, const config_t *config) {
+static inline void instr_DXYN_quirks(chip8_t *chip8, const extension_t extension) {
     // 0x0DXYN: Draw N height sprite at coordinates X, Y; Read from memory location I
     // Screen pixels are XOR'd with sprite bits
     // VF (Carry flag) is set if any screen pixels are set off; This is useful
     // for collision detection or other reasons.
-    uint8_t X_coord = chip8->V[chip8->inst.X] % config->window_width;
-    uint8_t Y_coord = chip8->V[chip8->inst.Y] % config->window_height;
-    const uint8_t orig_X = X_coord; // Original X value
+    // SCHIP/XO-CHIP DXY0 draws a 16x16 sprite, two bytes per row
+    // Every selected plane gets its own sprite, stored one after the other from I
+    // Whole sprite rows are shifted into place and XOR'd a word at a time
+    // Plain CHIP8 never leaves lores and only draws the first plane, its copy has constant geometry
+    const bool hires = extension != CHIP8 && chip8->hires;
+    const uint32_t width = hires ? DISPLAY_WIDTH : LORES_WIDTH;
+    const uint32_t height = hires ? DISPLAY_HEIGHT : LORES_HEIGHT;
+    const uint32_t planes = extension == X0CHIP ? chip8->planes : 1;
+    const uint32_t X_coord = chip8->V[chip8->inst.X] & (width - 1); // Sizes are powers of two
+    const uint32_t Y_coord = chip8->V[chip8->inst.Y] & (height - 1);
+    const uint32_t word = X_coord / 64;
+    const uint32_t shift = X_coord % 64;
+    const bool wide = chip8->inst.N == 0 && extension != CHIP8;
+    const uint32_t sprite_height = wide ? 16 : chip8->inst.N;
+    const uint32_t sprite_bytes = wide ? 2 : 1;
+
+    // Pixels past the right edge of the screen are clipped, not wrapped
+    uint64_t clip[2];
+    for (uint32_t w = 0; w < 2; w++)
+    {
+        const uint32_t first_x = (word + w) * 64;
+        if (word + w >= DISPLAY_ROW_WORDS || first_x >= width)
+            clip[w] = 0;
+        else if (width - first_x >= 64)
+            clip[w] = ~0ull;
+        else
+            clip[w] = ~0ull << (64 - (width - first_x));
+    }
 
-    chip8->V[0xF] = 0; // Initialize carry flag to 0
+    uint64_t collision = 0;
+    // Stop drawing entire sprite if hit bottom edge of screen
+    const uint32_t rows = (Y_coord + sprite_height > height) ? height - Y_coord : sprite_height;
+    uint32_t sprite = chip8->I;
 
-    for (uint8_t i = 0; i < chip8->inst.N; i++)
+    for (uint32_t p = 0; p < DISPLAY_PLANES; p++)
     {
-        // Get next byte/row of sprite data
-        const uint8_t sprite_data = chip8->ram[chip8->I + i];
-        X_coord = orig_X; // Reset x for next row to draw
+        if (!(planes & (1u << p)))
+            continue;
 
-        for (int8_t j = 7; j >= 0; j--)
+        for (uint32_t i = 0; i < rows; i++)
         {
-            // If sprite pixel/bit is on and display pixel is on, set carry flag
-            bool *pixel = &chip8->display[Y_coord * config->window_width + X_coord];
-            const bool sprite_bit = (sprite_data & (1 << j));
-
-            if (sprite_bit && *pixel)
+            // Get next row of sprite data, may straddle two words
+            const uint32_t address = sprite + i * sprite_bytes;
+            uint64_t sprite_data = (uint64_t)chip8->ram[address & 0xFFF] << 56;
+            if (wide)
+                sprite_data |= (uint64_t)chip8->ram[(address + 1) & 0xFFF] << 48;
+            const uint64_t left = (sprite_data >> shift) & clip[0];
+            const uint64_t right = (shift ? sprite_data << (64 - shift) : 0) & clip[1];
+            uint64_t *row = &chip8->display[p][Y_coord + i][word];
+
+            if (left | right)
+                chip8->dirty_rows |= 1ull << (Y_coord + i);
+
+            STATS_ADD(chip8, dxyn_pixels, stats_popcount(left) + stats_popcount(right));
+
+            // Any sprite bit landing on a lit pixel sets the carry flag
+            collision |= row[0] & left;
+            row[0] ^= left;
+            if (right)
             {
-                chip8->V[0xF] = 1; // Set carry flag to 1
+                collision |= row[1] & right;
+                row[1] ^= right;
             }
-
-            // XOR display pixel width sprite pixel/bit
-            *pixel ^= sprite_bit;
-
-            // Stop drawing this row if hit right edge of screen
-            if (++X_coord >= config->window_width)
-                break;
         }
-        // Stop drawing entire sprite if hit bottom edge of screen
-        if (++Y_coord >= config->window_height)
-            break;
+
+        // Next plane's sprite follows this one, clipped rows included
+        sprite += sprite_height * sprite_bytes;
     }
+
+    chip8->V[0xF] = collision != 0; // Carry flag
     chip8->draw = true; // Will update screen on next 60hz tick
+
+    STATS_INC(chip8, dxyn_draws);
+    STATS_ADD(chip8, dxyn_collisions, collision != 0);
 }
+EXTENSION_VARIANTS(instr_DXYN)
 
 void instr_EXNN(chip8_t *chip8, const config_t *config){
     (void)config;
 
-    if(table_EXNN[chip8->inst.NN])
-        table_EXNN[chip8->inst.NN](chip8, config);
+    if(chip8->handlers->table_EXNN[chip8->inst.NN])
+        chip8->handlers->table_EXNN[chip8->inst.NN](chip8, config);
 }
 
 void instr_EX9E(chip8_t *chip8, const config_t *config) {
@@ -719,8 +789,15 @@ void instr_EXA1(chip8_t *chip8, const config_t *config) {
 
 void instr_FXNN(chip8_t *chip8, const config_t *config) {
     (void)config;
-    if(table_FXNN[chip8->inst.NN])
-        table_FXNN[chip8->inst.NN](chip8, config);
+    if(chip8->handlers->table_FXNN[chip8->inst.NN])
+        chip8->handlers->table_FXNN[chip8->inst.NN](chip8, config);
+}
+
+void instr_FN01(chip8_t *chip8, const config_t *config) {
+    (void)config;
+
+    // 0xFN01: XO-CHIP select bitplanes N for drawing, clearing and scrolling
+    chip8->planes = chip8->inst.X & ((1u << DISPLAY_PLANES) - 1);
 }
 
 void instr_FX07(chip8_t *chip8, const config_t *config) {
@@ -733,28 +810,28 @@ void instr_FX07(chip8_t *chip8, const config_t *config) {
 void instr_FX0A(chip8_t *chip8, const config_t *config) {
     (void)config;
 
-    static bool any_key_pressed = false;
-    static uint8_t key = 0xFF;
     // 0xFX0A: A key press is awaited, and then stored in VX (blocking operation, all instruction halted until next key event, delay and sound timers should continue processing).
-    for (uint8_t i = 0; key == 0xFF && i < sizeof(chip8->keypad); i++)
+    for (uint8_t i = 0; chip8->wait_key == 0xFF && i < sizeof(chip8->keypad); i++)
     {
         if (chip8->keypad[i])
         {
-            key = i;
-            any_key_pressed = true;
+            chip8->wait_key = i;
             break;
         }
     }
-    if (!any_key_pressed)
+    if (chip8->wait_key == 0xFF) {
         chip8->PC -= 2; // Keep getting the current opcode if no key has been pressed
+        chip8->idle = true; // Nothing to do until a key event
+    }
     else {
         // A key has been pressed also wait until its released and then set it
-        if(chip8->keypad[key])     // Busy loop CHIP8 till its released
+        if(chip8->keypad[chip8->wait_key]) {   // Busy loop CHIP8 till its released
             chip8->PC -= 2;
+            chip8->idle = true;
+        }
         else {
-            chip8->V[chip8->inst.X] = key; // i = key (offset into keypad array)
-            key = 0xFF;
-            any_key_pressed = false;
+            chip8->V[chip8->inst.X] = chip8->wait_key; // i = key (offset into keypad array)
+            chip8->wait_key = 0xFF;
         }
     }
 }
@@ -792,6 +869,7 @@ void instr_FX33(chip8_t *chip8, const config_t *config) {
     // 0xFX33: Store BCD representation of VX at memory offset from I
     // I = hundred's place, I+1 = ten's place, I+2 = one's place;
     uint8_t bcd = chip8->V[chip8->inst.X];
+    invalidate_icache(chip8, chip8->I, 3);
     chip8->ram[chip8->I + 2] = bcd % 10;
     bcd /= 10;
     chip8->ram[chip8->I + 1] = bcd % 10;
@@ -799,34 +877,33 @@ void instr_FX33(chip8_t *chip8, const config_t *config) {
     chip8->ram[chip8->I] = bcd;
 }
 
-void instr_FX55(chip8_t *chip8, const config_t *config) {
-    (void)config;
-
+static inline void instr_FX55_quirks(chip8_t *chip8, const extension_t extension) {
     // 0xFX55: Register dump V0-VX inclusive to memory offset from I;
     // SCHIP does not increment I, CHIP8 does increment I;
     // Note: Could make this a config flag to use SCHIP or CHIP8 logic for I
+    invalidate_icache(chip8, chip8->I, chip8->inst.X + 1);
     for (uint8_t i = 0; i <= chip8->inst.X; i++)
     {
-        if(config->current_extension == CHIP8){
+        if(extension == CHIP8){
             chip8->ram[chip8->I++] = chip8->V[i];
         }
         else
             chip8->ram[chip8->I + i] = chip8->V[i];
     }
 }
+EXTENSION_VARIANTS(instr_FX55)
 
-void instr_FX65(chip8_t *chip8, const config_t *config) {
-    (void)config;
-
+static inline void instr_FX65_quirks(chip8_t *chip8, const extension_t extension) {
     // 0xFX65: Register load V0-VX inclusive to memory offset from I;
     // SCHIP does not increment I, CHIP8 does increment I;
     for (uint8_t i = 0; i <= chip8->inst.X; i++)
     {
-        if(config->current_extension == CHIP8)
+        if(extension == CHIP8)
         {
             chip8->V[i] = chip8->ram[chip8->I++];
         }
         else
             chip8->V[i] = chip8->ram[chip8->I + i];
     }
-}
\ No newline at end of file
+}
+EXTENSION_VARIANTS(instr_FX65)
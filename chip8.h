@@ -5,31 +5,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
-#include <SDL3/SDL.h>
+#include <stddef.h>
 
 #include "type_defs.h"
 
 #define NUM_KEYS 16
 
-    // QWERTY           // CHIP8-KeyMap
-const static uint8_t KEYMAP[NUM_KEYS][2] = {
-    {SDLK_1, 0x1},      // 1 
-    {SDLK_2, 0x2},      // 2
-    {SDLK_3, 0x3},      // 3
-    {SDLK_4, 0xC},      // C
-    {SDLK_Q, 0x4},      // 4
-    {SDLK_W, 0x5},      // 5
-    {SDLK_E, 0x6},      // 6
-    {SDLK_R, 0xD},      // D
-    {SDLK_A, 0x7},      // 7
-    {SDLK_S, 0x8},      // 8
-    {SDLK_D, 0x9},      // 9
-    {SDLK_F, 0xE},      // E
-    {SDLK_Z, 0xA},      // A
-    {SDLK_X, 0x0},      // 0
-    {SDLK_C, 0xB},      // B
-    {SDLK_V, 0xF}       // F
-};
+// Display is stored as packed rows, leftmost pixel in the most significant bit.
+// Sized for SCHIP/XO-CHIP hires, lores only uses the top left LORES_WIDTH x LORES_HEIGHT
+#define DISPLAY_WIDTH 128
+#define DISPLAY_HEIGHT 64
+#define DISPLAY_ROW_WORDS ((DISPLAY_WIDTH + 63) / 64)
+#define DISPLAY_PLANES 2            // XO-CHIP bitplanes, CHIP8/SCHIP only draw to the first
+#define LORES_WIDTH 64
+#define LORES_HEIGHT 32
+#define BREAKPOINT_WORDS (4096 / 64)  // Bit per ram address
 
 struct instruction
 {
@@ -41,11 +31,33 @@ struct instruction
     uint8_t Y;    // 4 bit register identifier
 };
 
+typedef void (*instruction_func_t)(chip8_t *chip8, const config_t *config);
+
+// Predecoded instruction, ready to run without touching the callback tables again
+struct decoded_instruction
+{
+    instruction_func_t handler;     // Final handler after sub table dispatch, NULL if not decoded yet
+    instruction_t inst;             // Operands filled out from the opcode
+};
+
+// Breakpoints and write watchpoints from a debugger, chip8_t only points here while any are armed
+struct breakpoints
+{
+    uint64_t exec[BREAKPOINT_WORDS];    // Stop before running the instruction at this address
+    uint64_t write[BREAKPOINT_WORDS];   // Stop after an instruction writes this address
+    uint32_t num_exec;
+    uint32_t num_write;
+    bool hit;                           // chip8_step stopped on one, cleared by the debugger
+    bool watch_hit;                     // It was a write, watch_address holds the address written
+    uint16_t watch_address;
+};
+
 enum emulator_state
 {
     QUIT = 0,
     RUNNING,
     PAUSED,
+    REWINDING,
 };
 
 // Chip-8 machine object
@@ -53,8 +65,10 @@ struct chip8
 {
     emulator_state_t state;
     uint8_t ram[4096];
-    bool display[64 * 32];          // Emulator original resolution pixels
-    uint32_t pixel_color[64 * 32];  // CHIP8 pixel colors to draw
+    uint64_t display[DISPLAY_PLANES][DISPLAY_HEIGHT][DISPLAY_ROW_WORDS]; // Emulator resolution pixels, 1 bit each per plane
+    uint32_t pixel_color[DISPLAY_WIDTH * DISPLAY_HEIGHT]; // CHIP8 pixel colors to draw, DISPLAY_WIDTH per row
+    bool hires;                     // SCHIP/XO-CHIP 128x64 mode, 00FF on / 00FE off
+    uint8_t planes;                 // Bitplanes drawn, cleared and scrolled, bit per plane (XO-CHIP FN01)
     uint16_t stack[12];             // Subroutine stack
     uint16_t *stack_ptr;
     uint8_t V[16];                  // Data registers V0 - VF
@@ -62,27 +76,78 @@ struct chip8
     uint16_t PC;                    // Program Counter
     uint8_t sound_timer;            // Decrement at 60hz and plays tone when > 0z
     uint8_t delay_timer;            // Decrement at 60hz when > 0
+    uint32_t audio_phase;           // Square wave sample index of this machine's beeper
+    uint32_t audio_tone_left;       // Tone samples still to queue for sound_timer's remaining duration
+    uint8_t audio_timer;            // sound_timer when audio_tone_left was last updated
+    uint64_t rng;                   // xorshift64* state for CXNN, seeded from config seed
+    uint8_t wait_key;               // FX0A key pressed and waiting for release, 0xFF if none
+#ifdef CHIP8_STATS
+    chip8_stats_t *stats;           // Execution counters, NULL when not collecting
+#endif
     bool keypad[16];                // Hexadecimal keypad 0x0 - 0xF
     const char *rom_name;           // Currently running ROM
     instruction_t inst;             // Currently executing instruction
     bool draw;                      // Update the screen yes/no
+    bool idle;                      // Spinning until the next timer tick or key, rest of frame skipped
+    uint64_t dirty_rows;            // Display rows changed since last screen update, bit per row
+    const handler_table_t *handlers; // Handler tables of the extension picked at load
+    decoded_instruction_t icache[4096]; // Predecoded instructions indexed by PC
+    uint16_t written_lo;            // Lowest ram address written since JIT last checked
+    uint16_t written_hi;            // One past highest ram address written, 0 if nothing written
+    breakpoints_t *breakpoints;     // Armed breakpoints, NULL runs without any checks
+    trace_t *trace;                 // Execution trace ring, NULL records nothing
 };
 
-typedef void (*instruction_func_t)(chip8_t *chip8, const config_t *config);
-
+// Core API, no window or audio device needed
+bool chip8_load_rom(chip8_t *chip8, const config_t *config, const uint8_t *rom, size_t rom_size);
 bool init_chip8(chip8_t *chip8, const config_t *config, const char rom_name[]);
-void handle_input(chip8_t *chip8, config_t *config);
-void handle_audio(chip8_t *chip8, const config_t *config, SDL_AudioStream *stream);
-#ifdef DEBUG
-void print_debug_info(chip8_t *chip8);
-#endif
+uint32_t chip8_step(chip8_t *chip8, const config_t *config, uint32_t num_insts);
+bool chip8_idle_jump(const chip8_t *chip8, uint16_t address, uint16_t target);
+void chip8_tick_timers(chip8_t *chip8);
+void chip8_set_key(chip8_t *chip8, uint8_t key, bool pressed);
+const uint64_t *chip8_framebuffer(const chip8_t *chip8);
+bool chip8_get_pixel(const chip8_t *chip8, uint32_t x, uint32_t y);
+
+// Active resolution, 128x64 in hires, 64x32 otherwise
+static inline uint32_t chip8_display_width(const chip8_t *chip8)
+{
+    return chip8->hires ? DISPLAY_WIDTH : LORES_WIDTH;
+}
+
+static inline uint32_t chip8_display_height(const chip8_t *chip8)
+{
+    return chip8->hires ? DISPLAY_HEIGHT : LORES_HEIGHT;
+}
+
 void emulate_instruction(chip8_t *chip8, const config_t *config);
-void update_timers(const sdl_t *sdl, chip8_t *chip8);
+void emulate_instruction_reference(chip8_t *chip8, const config_t *config);
+void invalidate_icache(chip8_t *chip8, uint16_t address, uint16_t length);
+
+static inline bool breakpoint_test(const uint64_t *bitmap, uint16_t address)
+{
+    return (bitmap[(address & 0xFFF) >> 6] >> (address & 63)) & 1;
+}
 
 // Instructions 
 // TODO: Was lazy to name them so made it like this change later maybe
+
+// Quirk handlers have a copy per extension, e.g. instr_8XY6_CHIP8, picked by the extension's handler table
+#define DECLARE_EXTENSION_VARIANTS(name)                                \
+    void name##_CHIP8(chip8_t *chip8, const config_t *config);          \
+    void name##_SUPERCHIP(chip8_t *chip8, const config_t *config);      \
+    void name##_X0CHIP(chip8_t *chip8, const config_t *config)
+
+void instr_NOP(chip8_t *chip8, const config_t *config);
+
 void instr_00E0(chip8_t *chip8, const config_t *config);
 void instr_00EE(chip8_t *chip8, const config_t *config);
+void instr_00CN(chip8_t *chip8, const config_t *config);
+void instr_00DN(chip8_t *chip8, const config_t *config);
+void instr_00FB(chip8_t *chip8, const config_t *config);
+void instr_00FC(chip8_t *chip8, const config_t *config);
+void instr_00FD(chip8_t *chip8, const config_t *config);
+void instr_00FE(chip8_t *chip8, const config_t *config);
+void instr_00FF(chip8_t *chip8, const config_t *config);
 void instr_0NNN(chip8_t *chip8, const config_t *config);
 
 void instr_1NNN(chip8_t *chip8, const config_t *config);
@@ -95,26 +160,27 @@ void instr_7XNN(chip8_t *chip8, const config_t *config);
 
 void instr_8XYN(chip8_t *chip8, const config_t *config);
 void instr_8XY0(chip8_t *chip8, const config_t *config);
-void instr_8XY1(chip8_t *chip8, const config_t *config);
-void instr_8XY2(chip8_t *chip8, const config_t *config);
-void instr_8XY3(chip8_t *chip8, const config_t *config);
+DECLARE_EXTENSION_VARIANTS(instr_8XY1);
+DECLARE_EXTENSION_VARIANTS(instr_8XY2);
+DECLARE_EXTENSION_VARIANTS(instr_8XY3);
 void instr_8XY4(chip8_t *chip8, const config_t *config);
 void instr_8XY5(chip8_t *chip8, const config_t *config);
-void instr_8XY6(chip8_t *chip8, const config_t *config);
+DECLARE_EXTENSION_VARIANTS(instr_8XY6);
 void instr_8XY7(chip8_t *chip8, const config_t *config);
-void instr_8XYE(chip8_t *chip8, const config_t *config);
+DECLARE_EXTENSION_VARIANTS(instr_8XYE);
 
 void instr_9XY0(chip8_t *chip8, const config_t *config);
 void instr_ANNN(chip8_t *chip8, const config_t *config);
 void instr_BNNN(chip8_t *chip8, const config_t *config);
 void instr_CXNN(chip8_t *chip8, const config_t *config);
-void instr_DXYN(chip8_t *chip8, const config_t *config);
+DECLARE_EXTENSION_VARIANTS(instr_DXYN);
 
 void instr_EXNN(chip8_t *chip8, const config_t *config);
 void instr_EX9E(chip8_t *chip8, const config_t *config);
 void instr_EXA1(chip8_t *chip8, const config_t *config);
 
 void instr_FXNN(chip8_t *chip8, const config_t *config);
+void instr_FN01(chip8_t *chip8, const config_t *config);
 void instr_FX07(chip8_t *chip8, const config_t *config);
 void instr_FX0A(chip8_t *chip8, const config_t *config);
 void instr_FX15(chip8_t *chip8, const config_t *config);
@@ -122,7 +188,7 @@ void instr_FX18(chip8_t *chip8, const config_t *config);
 void instr_FX1E(chip8_t *chip8, const config_t *config);
 void instr_FX29(chip8_t *chip8, const config_t *config);
 void instr_FX33(chip8_t *chip8, const config_t *config);
-void instr_FX55(chip8_t *chip8, const config_t *config);
-void instr_FX65(chip8_t *chip8, const config_t *config);
+DECLARE_EXTENSION_VARIANTS(instr_FX55);
+DECLARE_EXTENSION_VARIANTS(instr_FX65);
 
 #endif
\ No newline at end of file
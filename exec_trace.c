@@ -0,0 +1,339 @@
+// open/ftruncate/mmap are POSIX
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "exec_trace.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Map size bytes of path, created and sized when writable
+static bool map_file(trace_t *trace, const char *path, size_t size, bool writable)
+{
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path, writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ, NULL,
+                              writable ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER file_size;
+    if (!writable && GetFileSizeEx(file, &file_size))
+        size = (size_t)file_size.QuadPart;
+    HANDLE mapping = size >= TRACE_HEADER_SIZE
+                   ? CreateFileMappingA(file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY,
+                                        (DWORD)((uint64_t)size >> 32), (DWORD)size, NULL)
+                   : NULL;
+    CloseHandle(file); // Mapping keeps the file open
+
+    if (!mapping)
+        return false;
+    trace->data = MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size);
+    if (!trace->data)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+    trace->mapping = mapping;
+#else
+    const int file = writable ? open(path, O_RDWR | O_CREAT | O_TRUNC, 0644) : open(path, O_RDONLY);
+    if (file < 0)
+        return false;
+
+    struct stat info;
+    bool sized = writable ? ftruncate(file, (off_t)size) == 0 : fstat(file, &info) == 0;
+    if (!writable && sized)
+        size = (size_t)info.st_size;
+
+    void *data = MAP_FAILED;
+    if (sized && size >= TRACE_HEADER_SIZE)
+        data = mmap(NULL, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, file, 0);
+    close(file); // Mapping keeps the file open
+
+    if (data == MAP_FAILED)
+        return false;
+    trace->data = data;
+#endif
+    trace->size = size;
+    return true;
+}
+
+// New trace file holding the last capacity records, rounded up to a power of two
+bool trace_create(trace_t *trace, const char *path, uint32_t capacity, extension_t extension)
+{
+    memset(trace, 0, sizeof(trace_t));
+
+    uint32_t slots = 1;
+    while (slots < capacity && slots < (1u << 30))
+        slots <<= 1;
+
+    if (!map_file(trace, path, TRACE_HEADER_SIZE + (size_t)slots * sizeof(trace_record_t), true))
+    {
+        fprintf(stderr, "Could not create trace file %s\n", path);
+        return false;
+    }
+
+    uint8_t *header = trace->data;
+    const uint16_t version = TRACE_VERSION;
+    const uint16_t record_size = sizeof(trace_record_t);
+    memcpy(&header[0], TRACE_MAGIC, 4);
+    memcpy(&header[4], &version, 2);
+    memcpy(&header[6], &record_size, 2);
+    memcpy(&header[8], &slots, 4);
+    header[24] = (uint8_t)extension;
+
+    trace->written = (uint64_t *)&header[16];
+    trace->records = (trace_record_t *)&header[TRACE_HEADER_SIZE];
+    trace->mask = slots - 1;
+    trace->extension = extension;
+    return true;
+}
+
+// Map an existing trace read only, for decoding
+bool trace_open(trace_t *trace, const char *path)
+{
+    memset(trace, 0, sizeof(trace_t));
+    if (!map_file(trace, path, 0, false))
+    {
+        fprintf(stderr, "Could not open trace file %s\n", path);
+        return false;
+    }
+
+    const uint8_t *header = trace->data;
+    uint16_t version, record_size;
+    uint32_t slots;
+    memcpy(&version, &header[4], 2);
+    memcpy(&record_size, &header[6], 2);
+    memcpy(&slots, &header[8], 4);
+    if (memcmp(header, TRACE_MAGIC, 4) != 0 || version != TRACE_VERSION || record_size != sizeof(trace_record_t) ||
+        !slots || (slots & (slots - 1)) || (trace->size - TRACE_HEADER_SIZE) / sizeof(trace_record_t) < slots)
+    {
+        fprintf(stderr, "%s is not a version %d trace file !\n", path, TRACE_VERSION);
+        trace_close(trace);
+        return false;
+    }
+
+    trace->written = (uint64_t *)&trace->data[16];
+    trace->head = *trace->written;
+    trace->records = (trace_record_t *)&trace->data[TRACE_HEADER_SIZE];
+    trace->mask = slots - 1;
+    trace->extension = (extension_t)header[24];
+    return true;
+}
+
+void trace_close(trace_t *trace)
+{
+    if (!trace->data)
+        return;
+
+#if defined(_WIN32)
+    UnmapViewOfFile(trace->data);
+    CloseHandle(trace->mapping);
+#else
+    munmap(trace->data, trace->size);
+#endif
+    memset(trace, 0, sizeof(trace_t));
+}
+
+// Oldest record number still in the ring, records run from here up to head
+uint64_t trace_first(const trace_t *trace)
+{
+    const uint64_t capacity = (uint64_t)trace->mask + 1;
+    return trace->head > capacity ? trace->head - capacity : 0;
+}
+
+const trace_record_t *trace_get(const trace_t *trace, uint64_t n)
+{
+    return &trace->records[n & trace->mask];
+}
+
+// Same text the old DEBUG build printed per instruction, from the values the record kept.
+// next is the record after it, NULL for the newest one, and says where control went
+void trace_describe(const trace_record_t *record, const trace_record_t *next, char *out, size_t size)
+{
+    const uint16_t opcode = record->opcode;
+    const uint8_t X = (opcode >> 8) & 0x0F;
+    const uint8_t Y = (opcode >> 4) & 0x0F;
+    const uint8_t N = opcode & 0x0F;
+    const uint8_t NN = opcode & 0xFF;
+    const uint16_t NNN = opcode & 0xFFF;
+    const uint8_t vx = record->vx;
+    const uint8_t vy = record->vy;
+    const bool skipped = next && next->pc != ((record->pc + 2) & 0xFFF);
+
+    const int prefix = snprintf(out, size, "Address: 0x%04X, Opcode: 0x%04X Description: ", record->pc, opcode);
+    if (prefix < 0 || (size_t)prefix >= size)
+        return;
+    out += prefix;
+    size -= (size_t)prefix;
+
+    if (record->flags & TRACE_BLOCK)
+    {
+        snprintf(out, size, "Translated block of %u instructions", record->aux);
+        return;
+    }
+
+    switch ((opcode >> 12) & 0x0F)
+    {
+    case 0x0:
+        if (NN == 0xE0 && Y == 0xE)
+            snprintf(out, size, "Clear screen");
+        else if (NN == 0xEE && Y == 0xE && next)
+            snprintf(out, size, "Return from subroutine to address 0x%04X", next->pc);
+        else if (NN == 0xEE && Y == 0xE)
+            snprintf(out, size, "Return from subroutine");
+        else if (NNN >> 4 == 0x00C || NNN >> 4 == 0x00D)
+            snprintf(out, size, "Scroll %s %d pixels", Y == 0xC ? "down" : "up", N);
+        else if (NNN == 0xFB || NNN == 0xFC)
+            snprintf(out, size, "Scroll %s 4 pixels", NN == 0xFB ? "right" : "left");
+        else if (NNN == 0xFD)
+            snprintf(out, size, "Exit interpreter");
+        else if (NNN == 0xFE || NNN == 0xFF)
+            snprintf(out, size, "Switch to %s mode", NN == 0xFF ? "128x64 hires" : "64x32 lores");
+        else
+            snprintf(out, size, "Unimplemented or invalid opcode !");
+        break;
+    case 0x1:
+        snprintf(out, size, "Jump to address NNN (0x%04X)", NNN);
+        break;
+    case 0x2:
+        snprintf(out, size, "Call subroutine at NNN (0x%04X)", NNN);
+        break;
+    case 0x3:
+        snprintf(out, size, "Check if V%X (0x%02X) == NN (0x%02X), skip next instruction if true", X, vx, NN);
+        break;
+    case 0x4:
+        snprintf(out, size, "Check if V%X (0x%02X) != NN (0x%02X), skip next instruction if true", X, vx, NN);
+        break;
+    case 0x5:
+        if (N == 0)
+            snprintf(out, size, "Check if V%X (0x%02X) == V%X (0x%02X), skip next instruction if true", X, vx, Y, vy);
+        else
+            snprintf(out, size, "Unimplemented or invalid opcode !");
+        break;
+    case 0x6:
+        snprintf(out, size, "Set register V%X = NN (0x%02X)", X, NN);
+        break;
+    case 0x7:
+        snprintf(out, size, "Set register V%X (0x%02X) += NN (0x%02X). Result: 0x%02X", X, vx, NN, (uint8_t)(vx + NN));
+        break;
+    case 0x8:
+        switch (N)
+        {
+        case 0x0:
+            snprintf(out, size, "Set register V%X = V%X (0x%02X)", X, Y, vy);
+            break;
+        case 0x1:
+            snprintf(out, size, "Set register V%X (0x%02X) |= V%X (0x%02X); Result: 0x%02X", X, vx, Y, vy, vx | vy);
+            break;
+        case 0x2:
+            snprintf(out, size, "Set register V%X (0x%02X) &= V%X (0x%02X); Result: 0x%02X", X, vx, Y, vy, vx & vy);
+            break;
+        case 0x3:
+            snprintf(out, size, "Set register V%X (0x%02X) ^= V%X (0x%02X); Result: 0x%02X", X, vx, Y, vy, vx ^ vy);
+            break;
+        case 0x4:
+            snprintf(out, size, "Set register V%X (0x%02X) += V%X (0x%02X); VF = 1 if carry; Result: 0x%02X VF=%X",
+                     X, vx, Y, vy, (uint8_t)(vx + vy), vx + vy > 255);
+            break;
+        case 0x5:
+            snprintf(out, size, "Set register V%X (0x%02X) -= V%X (0x%02X); VF = 1 if no borrow; Result: 0x%02X VF=%X",
+                     X, vx, Y, vy, (uint8_t)(vx - vy), vy <= vx);
+            break;
+        case 0x6:
+            snprintf(out, size, "Set register V%X (0x%02X) >>=1  VF = shifted off bit (%X); Result: 0x%02X",
+                     X, vx, vx & 1, vx >> 1);
+            break;
+        case 0x7:
+            snprintf(out, size, "Set register V%X (0x%02X) = V%X (0x%02X) - V%X; VF = 1 if no borrow; Result: 0x%02X VF=%X",
+                     X, vx, Y, vy, X, (uint8_t)(vy - vx), vx <= vy);
+            break;
+        case 0xE:
+            snprintf(out, size, "Set register V%X (0x%02X) <<=1  VF = shifted off bit (%X); Result: 0x%02X",
+                     X, vx, vx >> 7, (uint8_t)(vx << 1));
+            break;
+        default:
+            snprintf(out, size, "Unimplemented or invalid opcode !");
+            break;
+        }
+        break;
+    case 0x9:
+        snprintf(out, size, "Check if V%X (0x%02X) != V%X (0x%02X), skip next instruction if true", X, vx, Y, vy);
+        break;
+    case 0xA:
+        snprintf(out, size, "Set I to NNN (0x%04X)", NNN);
+        break;
+    case 0xB:
+        if (next)
+            snprintf(out, size, "Set PC to V0 + NNN (0x%04X); Result PC = 0x%04X", NNN, next->pc);
+        else
+            snprintf(out, size, "Set PC to V0 + NNN (0x%04X)", NNN);
+        break;
+    case 0xC:
+        snprintf(out, size, "Set V%X = random %% 256 & NN (0x%02X)", X, NN);
+        break;
+    case 0xD:
+        snprintf(out, size, "Draw N (%d) height sprite at coords V%X (0x%02X), V%X (0x%02X) "
+                            "from memory location I (0x%04X). Set VF = 1 if any pixels are turned off.",
+                 N, X, vx, Y, vy, record->I);
+        break;
+    case 0xE:
+        if (NN == 0x9E && next)
+            snprintf(out, size, "Skip next instruction if key in V%X (0x%02X) is pressed, Keypad value %d", X, vx, skipped);
+        else if (NN == 0xA1 && next)
+            snprintf(out, size, "Skip next instruction if key in V%X (0x%02X) is not pressed, Keypad value %d",
+                     X, vx, !skipped);
+        else if (NN == 0x9E || NN == 0xA1)
+            snprintf(out, size, "Skip next instruction if key in V%X (0x%02X) is %spressed", X, vx, NN == 0xA1 ? "not " : "");
+        else
+            snprintf(out, size, "Unimplemented or invalid opcode !");
+        break;
+    case 0xF:
+        switch (NN)
+        {
+        case 0x01:
+            snprintf(out, size, "Select bitplanes %X for drawing", X);
+            break;
+        case 0x0A:
+            snprintf(out, size, "Await until a key is pressed; Store key in V%X", X);
+            break;
+        case 0x1E:
+            snprintf(out, size, "I (0x%04X) += V%X (0x%02X); Result (I): 0x%04X", record->I, X, vx, record->I + vx);
+            break;
+        case 0x07:
+            snprintf(out, size, "Set V%X = delay timer value (0x%02X)", X, record->vx_after);
+            break;
+        case 0x15:
+            snprintf(out, size, "Set delay timer value = V%X (0x%02X)", X, vx);
+            break;
+        case 0x18:
+            snprintf(out, size, "Set sound timer value = V%X (0x%02X)", X, vx);
+            break;
+        case 0x29:
+            snprintf(out, size, "Set I to sprite location in memory for character in V%X (0x%02X). Result(VX*5) = (0x%02X)",
+                     X, vx, vx * 5);
+            break;
+        case 0x33:
+            snprintf(out, size, "Store BCD representation of V%X (0x%02X) at memory from I (0x%04X)", X, vx, record->I);
+            break;
+        case 0x55:
+            snprintf(out, size, "Register dump  V0-V%X (0x%02X) inclusive at memory from I (0x%04X)", X, vx, record->I);
+            break;
+        case 0x65:
+            snprintf(out, size, "Register load  V0-V%X (0x%02X) inclusive at memory from I (0x%04X)", X, vx, record->I);
+            break;
+        default:
+            snprintf(out, size, "Unimplemented or invalid opcode !");
+            break;
+        }
+        break;
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef EXEC_TRACE_H
+#define EXEC_TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "type_defs.h"
+#include "app.h"
+#include "chip8.h"
+
+#define TRACE_MAGIC "C8TR"
+#define TRACE_VERSION 1
+#define TRACE_DEFAULT_RECORDS (1u << 16)    // 1MB file, about 90 seconds at 700 instructions per second, stays in cache
+
+// File layout, native byte order: header, then a ring of fixed size records. Record n of the run
+// lives in slot n % capacity, so the file always holds the newest capacity instructions
+// Header: magic, u16 version, u16 record size, u32 capacity (power of two), u64 records written,
+// u8 extension, zero padded to TRACE_HEADER_SIZE
+#define TRACE_HEADER_SIZE 64
+
+#define TRACE_BLOCK 0x01            // Record stands for a whole JIT block starting at pc, aux instructions long
+
+// One executed instruction, register values from before it ran plus the VX/VF delta it made.
+// Where it went (00EE return, skips, BNNN) is the next record's pc, so it isn't stored
+struct trace_record
+{
+    uint16_t pc;
+    uint16_t opcode;
+    uint16_t I;
+    uint16_t aux;                   // Block length for TRACE_BLOCK
+    uint8_t vx;
+    uint8_t vy;
+    uint8_t vf;
+    uint8_t vx_after;
+    uint8_t vf_after;
+    uint8_t flags;                  // TRACE_*
+    uint8_t reserved[2];
+};
+
+// File mapped trace ring. Writes go straight to the page cache, so the history survives a crash
+struct trace
+{
+    uint8_t *data;                  // Header, then the records
+    size_t size;
+    trace_record_t *records;
+    uint64_t *written;              // Header's record count, updated per record
+    uint64_t head;                  // Same count kept off the mapping for the hot path
+    uint32_t mask;                  // Capacity - 1
+    extension_t extension;
+    void *mapping;                  // Platform handle kept for unmapping
+};
+
+bool trace_create(trace_t *trace, const char *path, uint32_t capacity, extension_t extension);
+bool trace_open(trace_t *trace, const char *path);
+void trace_close(trace_t *trace);
+uint64_t trace_first(const trace_t *trace);
+const trace_record_t *trace_get(const trace_t *trace, uint64_t n);
+void trace_describe(const trace_record_t *record, const trace_record_t *next, char *out, size_t size);
+
+// Called around every interpreted instruction while chip8->trace is set, inline stores only
+static inline trace_record_t *trace_begin(trace_t *trace, const chip8_t *chip8, uint16_t address,
+                                          const instruction_t *inst, uint8_t flags, uint16_t aux)
+{
+    trace_record_t *record = &trace->records[trace->head & trace->mask];
+    *record = (trace_record_t){
+        .pc = address,
+        .opcode = inst->opcode,
+        .I = chip8->I,
+        .aux = aux,
+        .vx = chip8->V[inst->X],
+        .vy = chip8->V[inst->Y],
+        .vf = chip8->V[0xF],
+        .flags = flags,
+    };
+    return record;
+}
+
+static inline void trace_end(trace_t *trace, trace_record_t *record, const chip8_t *chip8, uint8_t x)
+{
+    record->vx_after = chip8->V[x];
+    record->vf_after = chip8->V[0xF];
+    *trace->written = ++trace->head;
+}
+
+#endif
@@ -0,0 +1,194 @@
+#include <string.h>
+
+#include "fade.h"
+#include "app.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__)
+#define FADE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(FADE_SSE2) && (defined(__GNUC__) || defined(__clang__))
+#define FADE_AVX2 1     // Compiled with target attribute, picked at runtime if the cpu has it
+#include <immintrin.h>
+#elif defined(FADE_SSE2) && defined(__AVX2__)
+#define FADE_AVX2 1     // e.g. MSVC /arch:AVX2
+#include <immintrin.h>
+#endif
+
+// Fade kernel: move every color channel rate/256 of the way towards its target,
+// rounding the step up so pixels always converge exactly
+typedef void (*fade_kernel_t)(uint32_t *colors, const uint32_t *targets, uint32_t count, uint32_t rate);
+
+static void fade_scalar(uint32_t *colors, const uint32_t *targets, uint32_t count, uint32_t rate)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t color = 0;
+        for (uint32_t shift = 0; shift < 32; shift += 8)
+        {
+            const uint32_t c = (colors[i] >> shift) & 0xFF;
+            const uint32_t t = (targets[i] >> shift) & 0xFF;
+            const uint32_t channel = (t > c) ? c + (((t - c) * rate + 255) >> 8)
+                                             : c - (((c - t) * rate + 255) >> 8);
+            color |= channel << shift;
+        }
+        colors[i] = color;
+    }
+}
+
+#ifdef FADE_SSE2
+// 16 bit lanes: (diff * rate + 255) >> 8, diff <= 255 and rate <= 256 never overflows
+static __m128i fade_step_sse2(__m128i diff, __m128i rate, __m128i round)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_unpacklo_epi8(diff, zero);
+    __m128i hi = _mm_unpackhi_epi8(diff, zero);
+    lo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(lo, rate), round), 8);
+    hi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(hi, rate), round), 8);
+    return _mm_packus_epi16(lo, hi);
+}
+
+static void fade_sse2(uint32_t *colors, const uint32_t *targets, uint32_t count, uint32_t rate)
+{
+    const __m128i rate16 = _mm_set1_epi16((short)rate);
+    const __m128i round = _mm_set1_epi16(255);
+    uint32_t i = 0;
+
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128i c = _mm_loadu_si128((const __m128i *)&colors[i]);
+        const __m128i t = _mm_loadu_si128((const __m128i *)&targets[i]);
+        const __m128i up = fade_step_sse2(_mm_subs_epu8(t, c), rate16, round);
+        const __m128i down = fade_step_sse2(_mm_subs_epu8(c, t), rate16, round);
+        _mm_storeu_si128((__m128i *)&colors[i], _mm_subs_epu8(_mm_adds_epu8(c, up), down));
+    }
+
+    fade_scalar(&colors[i], &targets[i], count - i, rate);
+}
+#endif
+
+#ifdef FADE_AVX2
+#if defined(__GNUC__) || defined(__clang__)
+#define FADE_AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define FADE_AVX2_TARGET
+#endif
+
+FADE_AVX2_TARGET static __m256i fade_step_avx2(__m256i diff, __m256i rate, __m256i round)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i lo = _mm256_unpacklo_epi8(diff, zero);
+    __m256i hi = _mm256_unpackhi_epi8(diff, zero);
+    lo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(lo, rate), round), 8);
+    hi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(hi, rate), round), 8);
+    return _mm256_packus_epi16(lo, hi); // Per 128 bit lane, matches the unpacks
+}
+
+FADE_AVX2_TARGET static void fade_avx2(uint32_t *colors, const uint32_t *targets, uint32_t count, uint32_t rate)
+{
+    const __m256i rate16 = _mm256_set1_epi16((short)rate);
+    const __m256i round = _mm256_set1_epi16(255);
+    uint32_t i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m256i c = _mm256_loadu_si256((const __m256i *)&colors[i]);
+        const __m256i t = _mm256_loadu_si256((const __m256i *)&targets[i]);
+        const __m256i up = fade_step_avx2(_mm256_subs_epu8(t, c), rate16, round);
+        const __m256i down = fade_step_avx2(_mm256_subs_epu8(c, t), rate16, round);
+        _mm256_storeu_si256((__m256i *)&colors[i], _mm256_subs_epu8(_mm256_adds_epu8(c, up), down));
+    }
+
+    fade_sse2(&colors[i], &targets[i], count - i, rate);
+}
+#endif
+
+static fade_kernel_t fade_kernel = fade_scalar;
+static const char *fade_kernel_label = "scalar";
+
+void init_fade(fade_t *fade)
+{
+    memset(fade, 0, sizeof(fade_t));
+
+#if defined(FADE_AVX2) && (defined(__GNUC__) || defined(__clang__))
+    if (__builtin_cpu_supports("avx2"))
+    {
+        fade_kernel = fade_avx2;
+        fade_kernel_label = "avx2";
+        return;
+    }
+#elif defined(FADE_AVX2)
+    fade_kernel = fade_avx2;
+    fade_kernel_label = "avx2";
+    return;
+#endif
+#ifdef FADE_SSE2
+    fade_kernel = fade_sse2;
+    fade_kernel_label = "sse2";
+#endif
+}
+
+const char *fade_kernel_name(void)
+{
+    return fade_kernel_label;
+}
+
+// Step fade by one frame, returns rows whose colors changed and need to be drawn
+uint64_t fade_update(fade_t *fade, chip8_t *chip8, const config_t *config)
+{
+    const uint32_t width = chip8_display_width(chip8);
+    const uint32_t height = chip8_display_height(chip8);
+    const uint32_t rate = config->color_lerp_rate >= 1.0f ? 256
+                        : config->color_lerp_rate <= 0.0f ? 1
+                        : (uint32_t)(config->color_lerp_rate * 256.0f + 0.5f);
+
+    // Pixel color by its bit in each plane, plane 0 in bit 0
+    const uint32_t palette[1 << DISPLAY_PLANES] = {
+        config->background_color, config->foreground_color, config->plane2_color, config->overlap_color,
+    };
+
+    // Rows the CPU drew to may have pixels with a new target color, rows below a lores screen are not shown
+    const uint64_t shown = height >= 64 ? ~0ull : (1ull << height) - 1;
+    const uint64_t rows = (fade->fading_rows | chip8->dirty_rows) & shown;
+    fade->fading_rows &= shown;
+    chip8->dirty_rows = 0;
+
+    // Everything converged and nothing drawn, no work at all
+    if (!rows)
+        return 0;
+
+    uint64_t changed = 0;
+
+    for (uint32_t y = 0; y < height; y++)
+    {
+        if (!(rows & (1ull << y)))
+            continue;
+
+        uint32_t *colors = &chip8->pixel_color[y * DISPLAY_WIDTH];
+        uint32_t targets[DISPLAY_WIDTH];
+
+        // Target colors for the row from the packed display bits, a word of each plane at a time
+        for (uint32_t w = 0; w * 64 < width; w++)
+        {
+            const uint64_t plane0 = chip8->display[0][y][w];
+            const uint64_t plane1 = chip8->display[1][y][w];
+            for (uint32_t bit = 0; bit < 64; bit++)
+            {
+                const uint32_t index = ((plane0 >> (63 - bit)) & 1) | (((plane1 >> (63 - bit)) & 1) << 1);
+                targets[w * 64 + bit] = palette[index];
+            }
+        }
+
+        fade_kernel(colors, targets, width, rate);
+        changed |= 1ull << y;
+
+        // Row stays in the work set until every pixel reached its target
+        if (memcmp(colors, targets, width * sizeof(uint32_t)) != 0)
+            fade->fading_rows |= 1ull << y;
+        else
+            fade->fading_rows &= ~(1ull << y);
+    }
+
+    return changed;
+}
@@ -0,0 +1,24 @@
+#ifndef FADE_H
+#define FADE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "type_defs.h"
+#include "chip8.h"
+
+// Phosphor fade state, pixel_color moves towards foreground/background color every frame
+struct fade
+{
+    uint64_t fading_rows;           // Rows with any pixel not yet at its target color, bit per row
+};
+
+void init_fade(fade_t *fade);
+
+// Step fade by one frame, returns rows whose colors changed and need to be drawn
+uint64_t fade_update(fade_t *fade, chip8_t *chip8, const config_t *config);
+
+// Kernel name picked at startup (avx2, sse2 or scalar)
+const char *fade_kernel_name(void);
+
+#endif
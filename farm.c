@@ -0,0 +1,477 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app.h"
+#include "chip8.h"
+#include "jit.h"
+#include "platform.h"
+#include "verify.h"
+
+#define DEFAULT_FRAMES 600      // Ten emulated seconds per job
+
+// ROM image shared read only by every job running it
+typedef struct farm_rom
+{
+    const char *path;
+    uint8_t *data;
+    size_t size;
+} farm_rom_t;
+
+typedef struct farm_job
+{
+    size_t rom;                 // Index into farm roms
+    uint32_t instance;          // Copy number when running each ROM more than once
+    uint32_t worker;            // Worker that ran the job
+    uint64_t hash;              // FNV-1a of the final display
+    uint64_t insts;             // Instructions executed
+    uint64_t ns;                // Wall time of the run
+    bool diverged;              // --verify found the engine and the reference apart
+    bool reproduced;            // Replay found the exact instruction
+    uint64_t diverged_frame;
+    uint64_t diverged_inst;
+    uint16_t diverged_pc;
+    uint16_t diverged_opcode;
+    uint16_t diverged_block_length;
+    chip8_t *diverged_states;   // Engine and reference machine where they diverged, for the dump
+} farm_job_t;
+
+typedef struct farm farm_t;
+
+// Each worker owns a range of jobs [top, bottom). It takes from the top,
+// idle workers steal the bottom half of someone else's range
+typedef struct farm_worker
+{
+    farm_t *farm;
+    uint32_t index;
+    platform_mutex_t *lock;     // Guards top/bottom
+    size_t top;
+    size_t bottom;
+    uint64_t jobs_run;
+    uint64_t steals;
+    bool pinned;
+    jit_t *jit;                 // NULL when interpreting
+    verifier_t *verifier;       // NULL unless verifying
+    chip8_t chip8;              // Machine reused for every job this worker runs
+} farm_worker_t;
+
+struct farm
+{
+    config_t config;
+    farm_rom_t *roms;
+    farm_job_t *jobs;
+    size_t num_jobs;
+    farm_worker_t *workers;
+    uint32_t num_workers;
+    uint64_t frames;            // Frames per job, 0 for no limit
+    uint64_t insts;             // Instructions per job, 0 for no limit
+    uint64_t verify;            // Instructions between lockstep compares, 0 when not verifying
+    bool pin;
+};
+
+// FNV-1a over the display rows of every plane, stable across hosts and builds
+static uint64_t display_hash(const chip8_t *chip8)
+{
+    const uint64_t *rows = chip8_framebuffer(chip8);
+    uint64_t hash = 0xCBF29CE484222325ull;
+
+    for (size_t i = 0; i < DISPLAY_PLANES * DISPLAY_HEIGHT * DISPLAY_ROW_WORDS; i++)
+    {
+        for (int b = 0; b < 8; b++)
+        {
+            hash ^= (rows[i] >> (8 * b)) & 0xFF;
+            hash *= 0x100000001B3ull;
+        }
+    }
+    return hash;
+}
+
+// Engine and reference interpreter in lockstep, keeps both machines of a divergence for the report
+static void verify_job(farm_worker_t *worker, farm_job_t *job, const config_t *config)
+{
+    const farm_t *farm = worker->farm;
+    const farm_rom_t *rom = &farm->roms[job->rom];
+    verifier_t *verifier = worker->verifier;
+
+    const uint64_t start = platform_now_ns();
+    job->diverged = !verify_rom(verifier, config, rom->data, rom->size, farm->frames, farm->insts);
+    job->ns = platform_now_ns() - start;
+    job->insts = verifier->insts;
+    job->hash = display_hash(&verifier->fast);
+    job->worker = worker->index;
+
+    if (!job->diverged)
+        return;
+    job->reproduced = verifier->reproduced;
+    job->diverged_frame = verifier->diverged_frame;
+    job->diverged_inst = verifier->diverged_inst;
+    job->diverged_pc = verifier->diverged_pc;
+    job->diverged_opcode = verifier->diverged_opcode;
+    job->diverged_block_length = verifier->diverged_block_length;
+    job->diverged_states = malloc(2 * sizeof(chip8_t));
+    if (job->diverged_states)
+    {
+        memcpy(&job->diverged_states[0], &verifier->fast, sizeof(chip8_t));
+        memcpy(&job->diverged_states[1], &verifier->reference, sizeof(chip8_t));
+        job->diverged_states[0].stack_ptr = job->diverged_states[0].stack + (verifier->fast.stack_ptr - verifier->fast.stack);
+        job->diverged_states[1].stack_ptr = job->diverged_states[1].stack + (verifier->reference.stack_ptr - verifier->reference.stack);
+    }
+}
+
+static void run_job(farm_worker_t *worker, farm_job_t *job)
+{
+    const farm_t *farm = worker->farm;
+    const farm_rom_t *rom = &farm->roms[job->rom];
+    chip8_t *chip8 = &worker->chip8;
+    config_t config = farm->config;
+    uint32_t remainder = 0;
+    uint64_t done = 0;
+
+    // Every instance gets its own random sequence, reproducible from the base seed
+    config.seed += job->instance;
+
+    if (worker->verifier)
+    {
+        verify_job(worker, job, &config);
+        return;
+    }
+
+    chip8_load_rom(chip8, &config, rom->data, rom->size);
+    if (worker->jit)
+        jit_flush(worker->jit);
+
+    const uint64_t start = platform_now_ns();
+    for (uint64_t frame = 0; (!farm->frames || frame < farm->frames) && (!farm->insts || done < farm->insts); frame++)
+    {
+        // Same fractional split per 60hz frame as the frontend
+        const uint32_t total = config.insts_per_second + remainder;
+        uint32_t n = total / 60;
+        remainder = total % 60;
+        if (farm->insts && done + n > farm->insts)
+            n = (uint32_t)(farm->insts - done);
+
+        if (worker->jit)
+            done += jit_run(worker->jit, chip8, &config, n);
+        else
+            done += chip8_step(chip8, &config, n);
+        chip8_tick_timers(chip8);
+    }
+
+    job->ns = platform_now_ns() - start;
+    job->insts = done;
+    job->hash = display_hash(chip8);
+    job->worker = worker->index;
+}
+
+// Next job for worker, stealing half of another worker's range when out. False when all done
+static bool take_job(farm_worker_t *worker, size_t *job)
+{
+    farm_t *farm = worker->farm;
+
+    platform_mutex_lock(worker->lock);
+    const bool own = worker->top < worker->bottom;
+    if (own)
+        *job = worker->top++;
+    platform_mutex_unlock(worker->lock);
+    if (own)
+        return true;
+
+    for (uint32_t i = 1; i < farm->num_workers; i++)
+    {
+        farm_worker_t *victim = &farm->workers[(worker->index + i) % farm->num_workers];
+
+        platform_mutex_lock(victim->lock);
+        const size_t available = victim->bottom - victim->top;
+        const size_t start = victim->bottom - (available + 1) / 2;
+        const size_t end = victim->bottom;
+        if (available)
+            victim->bottom = start;
+        platform_mutex_unlock(victim->lock);
+
+        if (!available)
+            continue;
+
+        // Run the first stolen job now, the rest become our range
+        platform_mutex_lock(worker->lock);
+        worker->top = start + 1;
+        worker->bottom = end;
+        platform_mutex_unlock(worker->lock);
+
+        worker->steals++;
+        *job = start;
+        return true;
+    }
+    return false;
+}
+
+static void worker_main(void *arg)
+{
+    farm_worker_t *worker = arg;
+    size_t job;
+
+    if (worker->farm->pin)
+        worker->pinned = platform_pin_thread(worker->index);
+
+    while (take_job(worker, &job))
+    {
+        run_job(worker, &worker->farm->jobs[job]);
+        worker->jobs_run++;
+    }
+}
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [--frames N] [--insts N] [--ips N] [--seed N] [--instances N] [--threads N] [--no-pin] [--extension chip8|schip|xochip] [--jit] [--verify [N]] "
+                    "[--list <file>] <rom or directory ...>\n", program);
+}
+
+// One rom or directory path per line, blank lines and # comments skipped
+static bool find_roms_from_list(const char *list, char ***roms, size_t *num_roms)
+{
+    char line[4096];
+    FILE *file = fopen(list, "r");
+    if (!file)
+        return false;
+
+    while (fgets(line, sizeof(line), file))
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#')
+            continue;
+        if (!platform_find_roms(line, roms, num_roms))
+            fprintf(stderr, "Skipping %s, not found\n", line);
+    }
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    farm_t farm = {0};
+    uint32_t instances = 1;
+    uint32_t num_threads = platform_cpu_count();
+    bool with_jit = false;
+    char **paths = NULL;
+    size_t num_paths = 0;
+
+    char *defaults[] = {argv[0]};
+    set_config_from_args(&farm.config, 1, defaults);
+    farm.config.seed = 0; // Reproducible unless --seed says otherwise
+    farm.pin = true;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            farm.frames = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--insts") == 0 && i + 1 < argc)
+            farm.insts = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--ips") == 0 && i + 1 < argc)
+            farm.config.insts_per_second = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+            farm.config.seed = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc)
+            instances = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            num_threads = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--no-pin") == 0)
+            farm.pin = false;
+        else if (strcmp(argv[i], "--extension") == 0 && i + 1 < argc)
+            farm.config.current_extension = extension_from_name(argv[++i]);
+        else if (strcmp(argv[i], "--jit") == 0)
+            with_jit = true;
+        else if (strcmp(argv[i], "--verify") == 0)
+        {
+            farm.verify = VERIFY_DEFAULT_INTERVAL;
+            if (i + 1 < argc && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9')
+                farm.verify = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--list") == 0 && i + 1 < argc)
+        {
+            if (!find_roms_from_list(argv[++i], &paths, &num_paths))
+                fprintf(stderr, "Could not open list %s\n", argv[i]);
+        }
+        else if (argv[i][0] == '-')
+        {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        else if (!platform_find_roms(argv[i], &paths, &num_paths))
+            fprintf(stderr, "Skipping %s, not found\n", argv[i]);
+    }
+
+    if (!num_paths || !instances || !num_threads || !farm.config.insts_per_second)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (!farm.frames && !farm.insts)
+        farm.frames = DEFAULT_FRAMES;
+
+    // Load every rom once up front, jobs only read them
+    farm.roms = calloc(num_paths, sizeof(farm_rom_t));
+    farm.jobs = calloc(num_paths * instances, sizeof(farm_job_t));
+    if (!farm.roms || !farm.jobs)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    size_t num_roms = 0;
+    for (size_t i = 0; i < num_paths; i++)
+    {
+        farm_rom_t *rom = &farm.roms[num_roms];
+        rom->path = paths[i];
+        rom->data = platform_read_file(paths[i], &rom->size);
+        if (!rom->data || rom->size > sizeof(farm.workers->chip8.ram) - 0x200)
+        {
+            fprintf(stderr, "Skipping %s, could not load\n", paths[i]);
+            free(rom->data);
+            continue;
+        }
+        for (uint32_t n = 0; n < instances; n++)
+            farm.jobs[farm.num_jobs++] = (farm_job_t){.rom = num_roms, .instance = n};
+        num_roms++;
+    }
+
+    if (num_threads > farm.num_jobs)
+        num_threads = farm.num_jobs ? (uint32_t)farm.num_jobs : 1;
+
+    farm.num_workers = num_threads;
+    farm.workers = calloc(num_threads, sizeof(farm_worker_t));
+    if (!farm.workers)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    // Contiguous starting ranges, stealing evens out ROMs that run slower
+    for (uint32_t w = 0; w < num_threads; w++)
+    {
+        farm_worker_t *worker = &farm.workers[w];
+        worker->farm = &farm;
+        worker->index = w;
+        worker->top = farm.num_jobs * w / num_threads;
+        worker->bottom = farm.num_jobs * (w + 1) / num_threads;
+        worker->lock = platform_mutex_create();
+        if (!worker->lock)
+        {
+            fprintf(stderr, "Could not create worker lock\n");
+            return EXIT_FAILURE;
+        }
+
+        if (with_jit)
+        {
+            worker->jit = calloc(1, sizeof(jit_t));
+            if (worker->jit && !init_jit(worker->jit))
+            {
+                free(worker->jit);
+                worker->jit = NULL;
+            }
+        }
+
+        if (farm.verify)
+        {
+            worker->verifier = malloc(sizeof(verifier_t));
+            if (!worker->verifier || !init_verifier(worker->verifier, worker->jit, farm.verify))
+            {
+                fprintf(stderr, "Out of memory\n");
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    const uint64_t start = platform_now_ns();
+
+    // Worker 0 runs on the main thread
+    platform_thread_t **threads = calloc(num_threads, sizeof(platform_thread_t *));
+    for (uint32_t w = 1; threads && w < num_threads; w++)
+    {
+        threads[w] = platform_thread_start(worker_main, &farm.workers[w]);
+        if (!threads[w])
+            fprintf(stderr, "Could not start worker %u, others will steal its jobs\n", w);
+    }
+    worker_main(&farm.workers[0]);
+    for (uint32_t w = 1; threads && w < num_threads; w++)
+        if (threads[w])
+            platform_thread_join(threads[w]);
+    free(threads);
+
+    const uint64_t wall_ns = platform_now_ns() - start;
+
+    // Results in job order so runs diff cleanly whatever the scheduling
+    uint64_t total_insts = 0;
+    printf("%-16s %12s %10s  %s\n", "Hash", "Insts", "ms", "ROM");
+    for (size_t i = 0; i < farm.num_jobs; i++)
+    {
+        const farm_job_t *job = &farm.jobs[i];
+        total_insts += job->insts;
+        printf("%016llx %12llu %10.3f  %s", (unsigned long long)job->hash, (unsigned long long)job->insts,
+               (double)job->ns / 1e6, farm.roms[job->rom].path);
+        if (instances > 1)
+            printf(" #%u", job->instance);
+        putchar('\n');
+    }
+
+    // Divergences after the table, the first differing instruction and both machines right after it
+    size_t num_diverged = 0;
+    for (size_t i = 0; i < farm.num_jobs; i++)
+    {
+        const farm_job_t *job = &farm.jobs[i];
+        if (!job->diverged)
+            continue;
+        num_diverged++;
+
+        printf("\nMISMATCH %s", farm.roms[job->rom].path);
+        if (instances > 1)
+            printf(" #%u", job->instance);
+        if (job->reproduced)
+        {
+            printf(": instruction %llu (frame %llu) at 0x%03X opcode 0x%04X", (unsigned long long)job->diverged_inst,
+                   (unsigned long long)job->diverged_frame, job->diverged_pc, job->diverged_opcode);
+            if (job->diverged_block_length)
+                printf(", somewhere in translated block 0x%03X-0x%03X", job->diverged_pc,
+                       job->diverged_pc + job->diverged_block_length - 1);
+            putchar('\n');
+        }
+        else
+            printf(": states differ by instruction %llu (frame %llu), replay did not diverge again\n",
+                   (unsigned long long)job->diverged_inst, (unsigned long long)job->diverged_frame);
+        if (job->diverged_states)
+            verify_dump(stdout, &job->diverged_states[0], &job->diverged_states[1]);
+    }
+
+    const double seconds = (double)wall_ns / 1e9;
+    fprintf(stderr, "\n%zu jobs on %u workers in %.3fs, %.1f Minst/s\n", farm.num_jobs, num_threads, seconds,
+            seconds > 0 ? (double)total_insts / seconds / 1e6 : 0.0);
+    for (uint32_t w = 0; w < num_threads; w++)
+    {
+        const farm_worker_t *worker = &farm.workers[w];
+        fprintf(stderr, "  worker %-3u %8llu jobs %6llu steals%s\n", w, (unsigned long long)worker->jobs_run,
+                (unsigned long long)worker->steals, worker->pinned ? "  pinned" : "");
+    }
+
+    if (farm.verify)
+        fprintf(stderr, "  %zu of %zu jobs diverged from the reference interpreter (%s)\n", num_diverged, farm.num_jobs,
+                with_jit ? "jit" : "cached interpreter");
+
+    for (uint32_t w = 0; w < num_threads; w++)
+    {
+        farm_worker_t *worker = &farm.workers[w];
+        free(worker->verifier);
+        if (worker->jit)
+        {
+            destroy_jit(worker->jit);
+            free(worker->jit);
+        }
+        platform_mutex_destroy(worker->lock);
+    }
+    for (size_t i = 0; i < farm.num_jobs; i++)
+        free(farm.jobs[i].diverged_states);
+    for (size_t i = 0; i < num_roms; i++)
+        free(farm.roms[i].data);
+    free(farm.workers);
+    free(farm.jobs);
+    free(farm.roms);
+    platform_free_roms(paths, num_paths);
+    return num_diverged ? EXIT_FAILURE : EXIT_SUCCESS;
+}
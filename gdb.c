@@ -0,0 +1,561 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gdb.h"
+
+// Register layout for 'g'/'p', multi byte registers are little endian
+static const char TARGET_XML[] =
+    "<?xml version=\"1.0\"?>\n"
+    "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">\n"
+    "<target version=\"1.0\">\n"
+    "<feature name=\"org.chip8.core\">\n"
+    "<reg name=\"v0\" bitsize=\"8\" type=\"uint8\" regnum=\"0\"/>\n"
+    "<reg name=\"v1\" bitsize=\"8\" type=\"uint8\"/>\n"
+    "<reg name=\"v2\" bitsize=\"8\" type=\"uint8\"/>\n"
+    "<reg name=\"v3\" bitsize=\"8\" type=\"uint8\"/>\n"
+    "<reg name=\"v4\" bitsize=\"8\" type=\"uint8\"/>\n"
+    "<reg name=\"v5\" bitsize=\"8\" type=\"uint8\"/>\n"
+    "<reg name=\"v6\" bitsize=\"8\" type=\"uint8\"/>\n"
+    "<reg name=\"v7\" bitsize=\"8\" type=\"uint8\"/>\n"
+    "<reg name=\"v8\" bitsize=\"8\" type=\"uint8\"/>\n"
+    "<reg name=\"v9\" bitsize=\"8\" type=\"uint8\"/>\n"
+    "<reg name=\"va\" bitsize=\"8\" type=\"uint8\"/>\n"
+    "<reg name=\"vb\" bitsize=\"8\" type=\"uint8\"/>\n"
+    "<reg name=\"vc\" bitsize=\"8\" type=\"uint8\"/>\n"
+    "<reg name=\"vd\" bitsize=\"8\" type=\"uint8\"/>\n"
+    "<reg name=\"ve\" bitsize=\"8\" type=\"uint8\"/>\n"
+    "<reg name=\"vf\" bitsize=\"8\" type=\"uint8\"/>\n"
+    "<reg name=\"i\" bitsize=\"16\" type=\"data_ptr\"/>\n"
+    "<reg name=\"pc\" bitsize=\"16\" type=\"code_ptr\"/>\n"
+    "<reg name=\"sp\" bitsize=\"8\" type=\"uint8\"/>\n"
+    "<reg name=\"dt\" bitsize=\"8\" type=\"uint8\"/>\n"
+    "<reg name=\"st\" bitsize=\"8\" type=\"uint8\"/>\n"
+    "</feature>\n"
+    "</target>\n";
+
+static const char HEX[] = "0123456789abcdef";
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// Hex number at *p, *p left on the first character after it
+static uint32_t parse_hex(const char **p)
+{
+    uint32_t value = 0;
+    for (int digit; (digit = hex_value(**p)) >= 0; (*p)++)
+        value = value << 4 | (uint32_t)digit;
+    return value;
+}
+
+static uint32_t register_size(uint32_t reg)
+{
+    return reg == 16 || reg == 17 ? 2 : 1;
+}
+
+static uint32_t read_register(const chip8_t *chip8, uint32_t reg)
+{
+    if (reg < 16)
+        return chip8->V[reg];
+    switch (reg)
+    {
+    case 16: return chip8->I;
+    case 17: return chip8->PC;
+    case 18: return (uint32_t)(chip8->stack_ptr - chip8->stack);
+    case 19: return chip8->delay_timer;
+    default: return chip8->sound_timer;
+    }
+}
+
+static void write_register(chip8_t *chip8, uint32_t reg, uint32_t value)
+{
+    if (reg < 16)
+    {
+        chip8->V[reg] = (uint8_t)value;
+        return;
+    }
+    switch (reg)
+    {
+    case 16: chip8->I = (uint16_t)value; break;
+    case 17: chip8->PC = (uint16_t)value; break;
+    case 18: chip8->stack_ptr = &chip8->stack[value < 12 ? value : 12]; break;
+    case 19: chip8->delay_timer = (uint8_t)value; break;
+    default: chip8->sound_timer = (uint8_t)value; break;
+    }
+}
+
+// Register as little endian hex, returns characters written
+static uint32_t format_register(char *out, const chip8_t *chip8, uint32_t reg)
+{
+    const uint32_t value = read_register(chip8, reg);
+    const uint32_t size = register_size(reg);
+    for (uint32_t i = 0; i < size; i++)
+    {
+        const uint8_t byte = (uint8_t)(value >> (i * 8));
+        out[i * 2] = HEX[byte >> 4];
+        out[i * 2 + 1] = HEX[byte & 0x0F];
+    }
+    return size * 2;
+}
+
+// Little endian hex register value at *p, false if it is cut short
+static bool parse_register(const char **p, uint32_t reg, uint32_t *value)
+{
+    *value = 0;
+    for (uint32_t i = 0; i < register_size(reg); i++)
+    {
+        const int hi = hex_value((*p)[0]);
+        const int lo = hi >= 0 ? hex_value((*p)[1]) : -1;
+        if (lo < 0)
+            return false;
+        *value |= (uint32_t)(hi << 4 | lo) << (i * 8);
+        *p += 2;
+    }
+    return true;
+}
+
+static void send_raw(gdb_t *gdb, const char *data, size_t size)
+{
+    if (gdb->client != PLATFORM_NO_SOCKET && !platform_send(gdb->client, data, size))
+    {
+        platform_close_socket(gdb->client);
+        gdb->client = PLATFORM_NO_SOCKET; // Noticed as a detach by gdb_serve
+    }
+}
+
+static void send_packet(gdb_t *gdb, const char *data)
+{
+    const size_t length = strlen(data);
+    uint8_t checksum = 0;
+    for (size_t i = 0; i < length; i++)
+        checksum += (uint8_t)data[i];
+
+    gdb->reply[0] = '$';
+    memcpy(&gdb->reply[1], data, length);
+    gdb->reply[length + 1] = '#';
+    gdb->reply[length + 2] = HEX[checksum >> 4];
+    gdb->reply[length + 3] = HEX[checksum & 0x0F];
+    send_raw(gdb, gdb->reply, length + 4);
+}
+
+// Why the machine stopped: a watched write, or a breakpoint/step (SIGTRAP)
+static void send_stop(gdb_t *gdb)
+{
+    char reply[32];
+    if (gdb->breakpoints.watch_hit)
+        snprintf(reply, sizeof(reply), "T05watch:%x;", gdb->breakpoints.watch_address);
+    else
+        snprintf(reply, sizeof(reply), "S05");
+    send_packet(gdb, reply);
+}
+
+static uint32_t count_bits(const uint64_t *bitmap)
+{
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < BREAKPOINT_WORDS; i++)
+        for (uint64_t word = bitmap[i]; word; word &= word - 1)
+            count++;
+    return count;
+}
+
+// Only point the machine at the bitmaps while something is armed, chip8_step is unchecked otherwise
+static void arm_breakpoints(gdb_t *gdb, chip8_t *chip8)
+{
+    gdb->breakpoints.num_exec = count_bits(gdb->breakpoints.exec);
+    gdb->breakpoints.num_write = count_bits(gdb->breakpoints.write);
+    chip8->breakpoints = gdb->breakpoints.num_exec || gdb->breakpoints.num_write ? &gdb->breakpoints : NULL;
+}
+
+static void detach(gdb_t *gdb, chip8_t *chip8)
+{
+    memset(&gdb->breakpoints, 0, sizeof(gdb->breakpoints));
+    arm_breakpoints(gdb, chip8);
+    gdb->halted = false;
+    if (gdb->client != PLATFORM_NO_SOCKET)
+    {
+        platform_close_socket(gdb->client);
+        gdb->client = PLATFORM_NO_SOCKET;
+        printf("Debugger detached\n");
+    }
+}
+
+static void clear_hit(gdb_t *gdb)
+{
+    gdb->breakpoints.hit = false;
+    gdb->breakpoints.watch_hit = false;
+}
+
+// Z/z packets: type,address,kind. Types 0/1 are breakpoints, 2 write watchpoints of kind bytes
+static void set_breakpoint(gdb_t *gdb, chip8_t *chip8, const char *packet)
+{
+    const bool insert = packet[0] == 'Z';
+    const char type = packet[1];
+    const char *p = &packet[2];
+    if (*p++ != ',')
+    {
+        send_packet(gdb, "E01");
+        return;
+    }
+    const uint32_t address = parse_hex(&p);
+    uint32_t kind = 1;
+    if (*p == ',')
+    {
+        p++;
+        kind = parse_hex(&p);
+    }
+
+    uint64_t *bitmap;
+    uint32_t length = 1;
+    if (type == '0' || type == '1')
+        bitmap = gdb->breakpoints.exec;
+    else if (type == '2')
+    {
+        bitmap = gdb->breakpoints.write;
+        length = kind ? kind : 1;
+    }
+    else
+    {
+        send_packet(gdb, ""); // Read and access watchpoints not supported
+        return;
+    }
+    if (address >= sizeof(chip8->ram) || length > sizeof(chip8->ram) - address)
+    {
+        send_packet(gdb, "E01");
+        return;
+    }
+
+    for (uint32_t a = address; a < address + length; a++)
+    {
+        if (insert)
+            bitmap[a >> 6] |= 1ull << (a & 63);
+        else
+            bitmap[a >> 6] &= ~(1ull << (a & 63));
+    }
+    arm_breakpoints(gdb, chip8);
+    send_packet(gdb, "OK");
+}
+
+// qXfer:features:read:target.xml:offset,length
+static void send_target_xml(gdb_t *gdb, const char *args)
+{
+    const char *p = args;
+    const uint32_t offset = parse_hex(&p);
+    uint32_t length = *p == ',' ? (p++, parse_hex(&p)) : 0;
+    const uint32_t total = (uint32_t)sizeof(TARGET_XML) - 1;
+
+    char reply[GDB_PACKET_SIZE];
+    if (offset >= total)
+    {
+        send_packet(gdb, "l");
+        return;
+    }
+    if (length > sizeof(reply) - 2)
+        length = sizeof(reply) - 2;
+    if (length > total - offset)
+        length = total - offset;
+
+    reply[0] = offset + length < total ? 'm' : 'l';
+    memcpy(&reply[1], &TARGET_XML[offset], length);
+    reply[length + 1] = '\0';
+    send_packet(gdb, reply);
+}
+
+static void handle_packet(gdb_t *gdb, chip8_t *chip8, const config_t *config)
+{
+    const char *packet = gdb->packet;
+    const char *p = &packet[1];
+    char reply[GDB_PACKET_SIZE];
+
+    switch (packet[0])
+    {
+    case '?':
+        send_stop(gdb);
+        break;
+
+    case 'g': {
+        uint32_t n = 0;
+        for (uint32_t reg = 0; reg < GDB_NUM_REGS; reg++)
+            n += format_register(&reply[n], chip8, reg);
+        reply[n] = '\0';
+        send_packet(gdb, reply);
+        break;
+    }
+
+    case 'G':
+        for (uint32_t reg = 0, value; reg < GDB_NUM_REGS && parse_register(&p, reg, &value); reg++)
+            write_register(chip8, reg, value);
+        send_packet(gdb, "OK");
+        break;
+
+    case 'p': {
+        const uint32_t reg = parse_hex(&p);
+        if (reg >= GDB_NUM_REGS)
+        {
+            send_packet(gdb, "E01");
+            break;
+        }
+        reply[format_register(reply, chip8, reg)] = '\0';
+        send_packet(gdb, reply);
+        break;
+    }
+
+    case 'P': {
+        const uint32_t reg = parse_hex(&p);
+        uint32_t value;
+        if (reg >= GDB_NUM_REGS || *p++ != '=' || !parse_register(&p, reg, &value))
+        {
+            send_packet(gdb, "E01");
+            break;
+        }
+        write_register(chip8, reg, value);
+        send_packet(gdb, "OK");
+        break;
+    }
+
+    case 'm': {
+        // Reads stop at the end of ram, gdb takes short replies
+        const uint32_t address = parse_hex(&p);
+        uint32_t length = *p == ',' ? (p++, parse_hex(&p)) : 0;
+        if (address >= sizeof(chip8->ram))
+        {
+            send_packet(gdb, "E01");
+            break;
+        }
+        if (length > sizeof(chip8->ram) - address)
+            length = (uint32_t)sizeof(chip8->ram) - address;
+        if (length > (sizeof(reply) - 1) / 2)
+            length = (sizeof(reply) - 1) / 2;
+        for (uint32_t i = 0; i < length; i++)
+        {
+            reply[i * 2] = HEX[chip8->ram[address + i] >> 4];
+            reply[i * 2 + 1] = HEX[chip8->ram[address + i] & 0x0F];
+        }
+        reply[length * 2] = '\0';
+        send_packet(gdb, reply);
+        break;
+    }
+
+    case 'M': {
+        const uint32_t address = parse_hex(&p);
+        const uint32_t length = *p == ',' ? (p++, parse_hex(&p)) : 0;
+        bool valid = *p++ == ':' && address < sizeof(chip8->ram) && length <= sizeof(chip8->ram) - address &&
+                     strlen(p) >= length * 2;
+        for (uint32_t i = 0; valid && i < length * 2; i++)
+            valid = hex_value(p[i]) >= 0;
+        if (!valid)
+        {
+            send_packet(gdb, "E01");
+            break;
+        }
+
+        // Drop cached and translated code over the write, without tripping the watchpoints
+        breakpoints_t *breakpoints = chip8->breakpoints;
+        chip8->breakpoints = NULL;
+        invalidate_icache(chip8, (uint16_t)address, (uint16_t)length);
+        chip8->breakpoints = breakpoints;
+        for (uint32_t i = 0; i < length; i++)
+            chip8->ram[address + i] = (uint8_t)(hex_value(p[i * 2]) << 4 | hex_value(p[i * 2 + 1]));
+        send_packet(gdb, "OK");
+        break;
+    }
+
+    case 'c':
+        // Continue, stepping off a breakpoint at PC first. No reply until the machine stops again
+        if (*p)
+            chip8->PC = (uint16_t)parse_hex(&p);
+        clear_hit(gdb);
+        if (breakpoint_test(gdb->breakpoints.exec, chip8->PC))
+            emulate_instruction(chip8, config);
+        gdb->halted = false;
+        break;
+
+    case 's':
+        if (*p)
+            chip8->PC = (uint16_t)parse_hex(&p);
+        clear_hit(gdb);
+        emulate_instruction(chip8, config);
+        send_stop(gdb);
+        clear_hit(gdb);
+        break;
+
+    case 'Z':
+    case 'z':
+        set_breakpoint(gdb, chip8, packet);
+        break;
+
+    case 'D':
+        send_packet(gdb, "OK");
+        detach(gdb, chip8);
+        break;
+
+    case 'k':
+        detach(gdb, chip8); // Machine keeps running, the window is closed to quit
+        break;
+
+    case 'H':
+        send_packet(gdb, "OK"); // Single thread
+        break;
+
+    case 'q':
+        if (strncmp(packet, "qSupported", 10) == 0)
+        {
+            snprintf(reply, sizeof(reply), "PacketSize=%x;qXfer:features:read+;QStartNoAckMode+", GDB_PACKET_SIZE);
+            send_packet(gdb, reply);
+        }
+        else if (strncmp(packet, "qXfer:features:read:target.xml:", 31) == 0)
+            send_target_xml(gdb, &packet[31]);
+        else if (strcmp(packet, "qAttached") == 0)
+            send_packet(gdb, "1");
+        else if (strcmp(packet, "qfThreadInfo") == 0)
+            send_packet(gdb, "m1");
+        else if (strcmp(packet, "qsThreadInfo") == 0)
+            send_packet(gdb, "l");
+        else if (strcmp(packet, "qC") == 0)
+            send_packet(gdb, "QC1");
+        else
+            send_packet(gdb, "");
+        break;
+
+    case 'Q':
+        if (strcmp(packet, "QStartNoAckMode") == 0)
+        {
+            send_packet(gdb, "OK");
+            gdb->no_ack = true; // Acked the old way one last time
+        }
+        else
+            send_packet(gdb, "");
+        break;
+
+    default:
+        send_packet(gdb, ""); // Not supported, gdb falls back
+        break;
+    }
+}
+
+// Packets are $data#xx, with + / - acks around them and a raw 0x03 to interrupt
+static void receive_byte(gdb_t *gdb, chip8_t *chip8, const config_t *config, char c)
+{
+    switch (gdb->parse)
+    {
+    case GDB_IDLE:
+        if (c == '$')
+        {
+            gdb->parse = GDB_DATA;
+            gdb->length = 0;
+            gdb->checksum = 0;
+            gdb->overflow = false;
+        }
+        else if (c == 0x03 && !gdb->halted)
+        {
+            gdb->halted = true;
+            send_packet(gdb, "S02"); // SIGINT
+        }
+        break;
+
+    case GDB_DATA:
+        if (c == '#')
+        {
+            gdb->parse = GDB_CHECKSUM_HI;
+            break;
+        }
+        gdb->checksum += (uint8_t)c;
+        if (gdb->length < GDB_PACKET_SIZE)
+            gdb->packet[gdb->length++] = c;
+        else
+            gdb->overflow = true;
+        break;
+
+    case GDB_CHECKSUM_HI:
+        gdb->received_checksum = (uint8_t)((hex_value(c) & 0x0F) << 4); // Bad digits just fail the check
+        gdb->parse = GDB_CHECKSUM_LO;
+        break;
+
+    case GDB_CHECKSUM_LO:
+        gdb->received_checksum |= (uint8_t)(hex_value(c) & 0x0F);
+        gdb->parse = GDB_IDLE;
+        if (!gdb->no_ack)
+        {
+            const bool good = gdb->received_checksum == gdb->checksum;
+            send_raw(gdb, good ? "+" : "-", 1);
+            if (!good)
+                break; // gdb sends it again
+        }
+        gdb->packet[gdb->length] = '\0';
+        if (gdb->overflow)
+            send_packet(gdb, "E01");
+        else
+            handle_packet(gdb, chip8, config);
+        break;
+    }
+}
+
+bool init_gdb(gdb_t *gdb, const char *address)
+{
+    memset(gdb, 0, sizeof(gdb_t));
+    gdb->address = address;
+    gdb->client = PLATFORM_NO_SOCKET;
+    gdb->listener = platform_listen(address);
+    if (gdb->listener == PLATFORM_NO_SOCKET)
+        return false;
+
+    printf("Debugger stub listening on %s\n", address);
+    return true;
+}
+
+// Accept a debugger, note stops and answer its packets. Waits up to timeout_ms for packets
+// while halted, never while running. Returns true while the debugger has the machine halted
+bool gdb_serve(gdb_t *gdb, chip8_t *chip8, const config_t *config, uint32_t timeout_ms)
+{
+    if (gdb->client == PLATFORM_NO_SOCKET)
+    {
+        if (gdb->halted)
+            detach(gdb, chip8); // Connection dropped
+        gdb->client = platform_accept(gdb->listener);
+        if (gdb->client == PLATFORM_NO_SOCKET)
+            return false;
+
+        // Attaching stops the machine, gdb asks why with '?'
+        printf("Debugger attached on %s\n", gdb->address);
+        gdb->halted = true;
+        gdb->no_ack = false;
+        gdb->parse = GDB_IDLE;
+    }
+
+    // Last run stopped on a breakpoint or watchpoint
+    if (!gdb->halted && gdb->breakpoints.hit)
+    {
+        gdb->halted = true;
+        send_stop(gdb);
+    }
+
+    char data[1024];
+    const int n = platform_recv(gdb->client, data, sizeof(data), gdb->halted ? timeout_ms : 0);
+    if (n < 0)
+    {
+        detach(gdb, chip8);
+        return false;
+    }
+    for (int i = 0; i < n && gdb->client != PLATFORM_NO_SOCKET; i++)
+        receive_byte(gdb, chip8, config, data[i]);
+
+    if (gdb->client == PLATFORM_NO_SOCKET)
+        detach(gdb, chip8);
+    return gdb->halted;
+}
+
+void destroy_gdb(gdb_t *gdb, chip8_t *chip8)
+{
+    detach(gdb, chip8);
+    platform_close_socket(gdb->listener);
+
+    // Unix socket files outlive the listener
+    platform_remove_socket(gdb->address);
+}
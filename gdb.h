@@ -0,0 +1,46 @@
+#ifndef GDB_H
+#define GDB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "type_defs.h"
+#include "app.h"
+#include "chip8.h"
+#include "platform.h"
+
+#define GDB_PACKET_SIZE 4096        // Largest packet accepted, advertised in qSupported
+#define GDB_POLL_MS 50              // Wait per gdb_serve while halted, keeps quit responsive
+#define GDB_NUM_REGS 21             // V0-VF, I, PC, SP, DT, ST
+
+enum gdb_parse
+{
+    GDB_IDLE = 0,                   // Between packets, acks and interrupts
+    GDB_DATA,                       // After '$'
+    GDB_CHECKSUM_HI,                // After '#'
+    GDB_CHECKSUM_LO,
+};
+
+// GDB Remote Serial Protocol server for one debugger at a time, served from the emulation loop
+struct gdb
+{
+    const char *address;            // Port or socket path listened on
+    platform_socket_t listener;
+    platform_socket_t client;       // PLATFORM_NO_SOCKET when no debugger is attached
+    breakpoints_t breakpoints;      // chip8->breakpoints points here while any are armed
+    bool halted;                    // Machine stopped, the emulation loop waits for continue or step
+    bool no_ack;                    // QStartNoAckMode, no +/- after packets
+    gdb_parse_t parse;
+    uint8_t checksum;               // Sum of the packet data so far
+    uint8_t received_checksum;
+    uint32_t length;
+    bool overflow;                  // Packet longer than GDB_PACKET_SIZE, answered with an error
+    char packet[GDB_PACKET_SIZE + 1];
+    char reply[GDB_PACKET_SIZE + 8]; // $, data, #, checksum
+};
+
+bool init_gdb(gdb_t *gdb, const char *address);
+bool gdb_serve(gdb_t *gdb, chip8_t *chip8, const config_t *config, uint32_t timeout_ms);
+void destroy_gdb(gdb_t *gdb, chip8_t *chip8);
+
+#endif
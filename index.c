@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "app.h"
+#include "rom_index.h"
+#include "platform.h"
+
+// Profile given by hand for one rom, matched by SHA-1 or by file name
+typedef struct index_override
+{
+    char key[256];              // 40 hex digit SHA-1 or rom file name
+    rom_profile_t profile;
+} index_override_t;
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [--out <file>] [--profiles <file>] [--extension chip8|schip|xochip] [--ips N] "
+                    "<rom or directory ...>\n", program);
+}
+
+static const char *base_name(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    const char *backslash = strrchr(path, '\\');
+    if (backslash > slash)
+        slash = backslash;
+    return slash ? slash + 1 : path;
+}
+
+// .sc8 and .xo8 are the usual SCHIP and XO-CHIP rom names
+static extension_t extension_from_file(const char *path, extension_t fallback)
+{
+    const char *dot = strrchr(path, '.');
+    if (dot && (strcmp(dot, ".sc8") == 0 || strcmp(dot, ".SC8") == 0))
+        return SUPERCHIP;
+    if (dot && (strcmp(dot, ".xo8") == 0 || strcmp(dot, ".XO8") == 0))
+        return X0CHIP;
+    return fallback;
+}
+
+static void sha1_hex(const uint8_t sha1[ROM_SHA1_SIZE], char hex[ROM_SHA1_SIZE * 2 + 1])
+{
+    for (int i = 0; i < ROM_SHA1_SIZE; i++)
+        snprintf(&hex[i * 2], 3, "%02x", sha1[i]);
+}
+
+// One profile per line: <sha1|file name> <chip8|schip|xochip> [ips] [foreground background as RRGGBBAA hex]
+// Blank lines and # comments skipped
+static bool read_profiles(const char *path, index_override_t **overrides, size_t *count)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return false;
+
+    char line[512];
+    while (fgets(line, sizeof(line), file))
+    {
+        char key[256], extension[16];
+        unsigned long ips = 0;
+        unsigned long foreground = 0, background = 0;
+
+        const char *p = line;
+        while (isspace((unsigned char)*p))
+            p++;
+        if (*p == '#' || *p == '\0')
+            continue;
+
+        const int fields = sscanf(p, "%255s %15s %lu %lx %lx", key, extension, &ips, &foreground, &background);
+        if (fields < 2)
+        {
+            fprintf(stderr, "Skipping profile line: %s", line);
+            continue;
+        }
+
+        index_override_t *grown = realloc(*overrides, (*count + 1) * sizeof(index_override_t));
+        if (!grown)
+            break;
+        *overrides = grown;
+
+        index_override_t *entry = &(*overrides)[(*count)++];
+        memcpy(entry->key, key, sizeof(key));
+        for (char *c = entry->key; *c; c++)
+            *c = (char)tolower((unsigned char)*c);
+        entry->profile = (rom_profile_t){
+            .extension = extension_from_name(extension),
+            .insts_per_second = fields >= 3 ? (uint32_t)ips : 0,
+            .flags = fields >= 5 ? ROM_PROFILE_COLORS : 0,
+            .foreground_color = (uint32_t)foreground,
+            .background_color = (uint32_t)background,
+        };
+    }
+
+    fclose(file);
+    return true;
+}
+
+static const index_override_t *find_override(const index_override_t *overrides, size_t count,
+                                             const char *hex, const char *path)
+{
+    char name[256];
+    size_t length = 0;
+    for (const char *c = base_name(path); *c && length + 1 < sizeof(name); c++)
+        name[length++] = (char)tolower((unsigned char)*c);
+    name[length] = '\0';
+
+    for (size_t i = 0; i < count; i++)
+        if (strcmp(overrides[i].key, hex) == 0 || strcmp(overrides[i].key, name) == 0)
+            return &overrides[i];
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    const char *out = ROM_INDEX_DEFAULT_PATH;
+    extension_t extension = CHIP8;
+    bool extension_given = false;
+    uint32_t ips = 0;
+    index_override_t *overrides = NULL;
+    size_t num_overrides = 0;
+    char **paths = NULL;
+    size_t num_paths = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+            out = argv[++i];
+        else if (strcmp(argv[i], "--profiles") == 0 && i + 1 < argc)
+        {
+            if (!read_profiles(argv[++i], &overrides, &num_overrides))
+                fprintf(stderr, "Could not open profiles %s\n", argv[i]);
+        }
+        else if (strcmp(argv[i], "--extension") == 0 && i + 1 < argc)
+        {
+            extension = extension_from_name(argv[++i]);
+            extension_given = true;
+        }
+        else if (strcmp(argv[i], "--ips") == 0 && i + 1 < argc)
+            ips = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (argv[i][0] == '-')
+        {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        else if (!platform_find_roms(argv[i], &paths, &num_paths))
+            fprintf(stderr, "Skipping %s, not found\n", argv[i]);
+    }
+
+    if (!num_paths)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    rom_index_entry_t *entries = calloc(num_paths, sizeof(rom_index_entry_t));
+    if (!entries)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    // Hash every rom once, profile from the profiles file, else from the options and file name
+    size_t num_entries = 0;
+    size_t num_profiled = 0;
+    for (size_t i = 0; i < num_paths; i++)
+    {
+        size_t size;
+        uint8_t *data = platform_read_file(paths[i], &size);
+        if (!data)
+        {
+            fprintf(stderr, "Skipping %s, could not read\n", paths[i]);
+            continue;
+        }
+
+        rom_index_entry_t *entry = &entries[num_entries++];
+        char hex[ROM_SHA1_SIZE * 2 + 1];
+        rom_sha1(data, size, entry->sha1);
+        sha1_hex(entry->sha1, hex);
+        free(data);
+
+        const index_override_t *override = find_override(overrides, num_overrides, hex, paths[i]);
+        if (override)
+        {
+            entry->profile = override->profile;
+            num_profiled++;
+        }
+        else
+        {
+            entry->profile = (rom_profile_t){
+                .extension = extension_given ? extension : extension_from_file(paths[i], CHIP8),
+                .insts_per_second = ips,
+            };
+        }
+    }
+
+    const bool ok = rom_index_write(out, entries, num_entries);
+    if (ok)
+        printf("Indexed %zu roms (%zu from profiles) into %s\n", num_entries, num_profiled, out);
+
+    free(entries);
+    free(overrides);
+    platform_free_roms(paths, num_paths);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
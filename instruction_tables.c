@@ -3,67 +3,183 @@
 // TODO: U used func callbacks to manage all 
 // But maybe u made it complicated ? Go back to switch case ? 
 
-// Opcode Function Callback Table
-instruction_func_t opcode_table[16] = {
-    instr_0NNN, // 0x0***
-    instr_1NNN, // 0x1***
-    instr_2NNN, // 0x2***
-    instr_3XNN, // 0x3***
-    instr_4XNN, // 0x4***
-    instr_5XY0, // 0x5***
-    instr_6XNN, // 0x6***
-    instr_7XNN, // 0x7***
-    instr_8XYN, // 0x8***
-    instr_9XY0, // 0x9***
-    instr_ANNN, // 0xA***
-    instr_BNNN, // 0xB***
-    instr_CXNN, // 0xC***
-    instr_DXYN, // 0xD***
-    instr_EXNN, // 0xE***
-    instr_FXNN  // 0xF***
-};
+// Opcodes only some extensions have: ONLY(handler) keeps them, NONE(handler) leaves the slot empty (NOP)
+#define ONLY(handler) handler
+#define NONE(handler) NULL
 
-// 0NNN Function Callback Table
-instruction_func_t table_0NNN[0x100] = {
-    [0xE0] = instr_00E0, // 0x00E0
-    [0xEE] = instr_00EE, // 0x00EE
-};
+// All sixteen 0x00XN opcodes of one row, e.g. ROW_00XN(0xC, h) fills 0xC0 - 0xCF
+#define ROW_00XN(row, handler) \
+    [row##0] = handler, [row##1] = handler, [row##2] = handler, [row##3] = handler, \
+    [row##4] = handler, [row##5] = handler, [row##6] = handler, [row##7] = handler, \
+    [row##8] = handler, [row##9] = handler, [row##A] = handler, [row##B] = handler, \
+    [row##C] = handler, [row##D] = handler, [row##E] = handler, [row##F] = handler
 
-// 8XYN Function Callback Table
-instruction_func_t table_8XYN[16] = {
-    instr_8XY0,  // 0x8XY0
-    instr_8XY1,  // 0x8XY1
-    instr_8XY2,  // 0x8XY2
-    instr_8XY3,  // 0x8XY3
-    instr_8XY4,  // 0x8XY4
-    instr_8XY5,  // 0x8XY5
-    instr_8XY6,  // 0x8XY6
-    instr_8XY7,  // 0x8XY7
-    NULL,
-    NULL,
-    NULL,
-    NULL,
-    NULL,
-    NULL,
-    instr_8XYE,   // 0x8XYE
-    NULL
-};
+// Handler tables of one extension, the single list every extension's tables are stamped from.
+// EXT picks the quirk handler copies, SCHIP/XOCHIP are ONLY or NONE for opcodes added by those extensions
+#define HANDLER_TABLE(EXT, SCHIP, XOCHIP)                                                   \
+    {                                                                                       \
+        /* Opcode Function Callback Table */                                                \
+        .opcode_table = {                                                                   \
+            instr_0NNN, /* 0x0*** */                                                        \
+            instr_1NNN, /* 0x1*** */                                                        \
+            instr_2NNN, /* 0x2*** */                                                        \
+            instr_3XNN, /* 0x3*** */                                                        \
+            instr_4XNN, /* 0x4*** */                                                        \
+            instr_5XY0, /* 0x5*** */                                                        \
+            instr_6XNN, /* 0x6*** */                                                        \
+            instr_7XNN, /* 0x7*** */                                                        \
+            instr_8XYN, /* 0x8*** */                                                        \
+            instr_9XY0, /* 0x9*** */                                                        \
+            instr_ANNN, /* 0xA*** */                                                        \
+            instr_BNNN, /* 0xB*** */                                                        \
+            instr_CXNN, /* 0xC*** */                                                        \
+            instr_DXYN_##EXT, /* 0xD*** */                                                  \
+            instr_EXNN, /* 0xE*** */                                                        \
+            instr_FXNN  /* 0xF*** */                                                        \
+        },                                                                                  \
+        /* 0NNN Function Callback Table */                                                  \
+        .table_0NNN = {                                                                     \
+            [0xE0] = instr_00E0,            /* 0x00E0 */                                    \
+            [0xEE] = instr_00EE,            /* 0x00EE */                                    \
+            ROW_00XN(0xC, SCHIP(instr_00CN)),   /* 0x00CN */                                \
+            ROW_00XN(0xD, XOCHIP(instr_00DN)),  /* 0x00DN */                                \
+            [0xFB] = SCHIP(instr_00FB),     /* 0x00FB */                                    \
+            [0xFC] = SCHIP(instr_00FC),     /* 0x00FC */                                    \
+            [0xFD] = SCHIP(instr_00FD),     /* 0x00FD */                                    \
+            [0xFE] = SCHIP(instr_00FE),     /* 0x00FE */                                    \
+            [0xFF] = SCHIP(instr_00FF),     /* 0x00FF */                                    \
+        },                                                                                  \
+        /* 8XYN Function Callback Table */                                                  \
+        .table_8XYN = {                                                                     \
+            [0x0] = instr_8XY0,             /* 0x8XY0 */                                    \
+            [0x1] = instr_8XY1_##EXT,       /* 0x8XY1 */                                    \
+            [0x2] = instr_8XY2_##EXT,       /* 0x8XY2 */                                    \
+            [0x3] = instr_8XY3_##EXT,       /* 0x8XY3 */                                    \
+            [0x4] = instr_8XY4,             /* 0x8XY4 */                                    \
+            [0x5] = instr_8XY5,             /* 0x8XY5 */                                    \
+            [0x6] = instr_8XY6_##EXT,       /* 0x8XY6 */                                    \
+            [0x7] = instr_8XY7,             /* 0x8XY7 */                                    \
+            [0xE] = instr_8XYE_##EXT,       /* 0x8XYE */                                    \
+        },                                                                                  \
+        /* EXNN Function Callback Table */                                                  \
+        .table_EXNN = {                                                                     \
+            [0x9E] = instr_EX9E,            /* 0xEX9E */                                    \
+            [0xA1] = instr_EXA1,            /* 0xEXA1 */                                    \
+        },                                                                                  \
+        /* FXNN Function Callback Table */                                                  \
+        .table_FXNN = {                                                                     \
+            [0x01] = XOCHIP(instr_FN01),    /* 0xFN01 */                                    \
+            [0x07] = instr_FX07,            /* 0xFX07 */                                    \
+            [0x0A] = instr_FX0A,            /* 0xFX0A */                                    \
+            [0x15] = instr_FX15,            /* 0xFX15 */                                    \
+            [0x18] = instr_FX18,            /* 0xFX18 */                                    \
+            [0x1E] = instr_FX1E,            /* 0xFX1E */                                    \
+            [0x29] = instr_FX29,            /* 0xFX29 */                                    \
+            [0x33] = instr_FX33,            /* 0xFX33 */                                    \
+            [0x55] = instr_FX55_##EXT,      /* 0xFX55 */                                    \
+            [0x65] = instr_FX65_##EXT,      /* 0xFX65 */                                    \
+        },                                                                                  \
+    }
 
-// EXNN Function Callback Table
-instruction_func_t table_EXNN[0x100] = {
-    [0x9E] = instr_EX9E,  // 0xEX9E
-    [0xA1] = instr_EXA1,  // 0xEXA1
+// One set of tables per extension, chip8_load_rom picks one for the machine
+const handler_table_t handler_tables[NUM_EXTENSIONS] = {
+    [CHIP8] = HANDLER_TABLE(CHIP8, NONE, NONE),
+    [SUPERCHIP] = HANDLER_TABLE(SUPERCHIP, ONLY, NONE),
+    [X0CHIP] = HANDLER_TABLE(X0CHIP, ONLY, ONLY),
 };
 
-// FXNN Function Callback Table
-instruction_func_t table_FXNN[0x100] = {
-    [0x07] = instr_FX07,  // 0xFX07
-    [0x0A] = instr_FX0A,  // 0xFX0A
-    [0x15] = instr_FX15,  // 0xFX15
-    [0x18] = instr_FX18,  // 0xFX18
-    [0x1E] = instr_FX1E,  // 0xFX1E
-    [0x29] = instr_FX29,  // 0xFX29
-    [0x33] = instr_FX33,  // 0xFX33
-    [0x55] = instr_FX55,  // 0xFX55
-    [0x65] = instr_FX65   // 0xFX65
+// Resolve opcode to its final handler, walking the sub tables once
+// so the predecoded cache can call it directly
+instruction_func_t decode_opcode(const handler_table_t *handlers, uint16_t opcode)
+{
+    instruction_func_t handler = NULL;
+
+    switch ((opcode >> 12) & 0x0F)
+    {
+    case 0x0:
+        handler = handlers->table_0NNN[opcode & 0x0FF];
+        break;
+    case 0x8:
+        handler = handlers->table_8XYN[opcode & 0x0F];
+        break;
+    case 0xE:
+        handler = handlers->table_EXNN[opcode & 0x0FF];
+        break;
+    case 0xF:
+        handler = handlers->table_FXNN[opcode & 0x0FF];
+        break;
+    default:
+        handler = handlers->opcode_table[(opcode >> 12) & 0x0F];
+        break;
+    }
+
+    // Unimplemented / invalid opcodes do nothing
+    return handler ? handler : instr_NOP;
+}
+
+// Printable names for opcode classes
+const char *opcode_class_names[NUM_OPCODE_CLASSES] = {
+    "00E0", "00EE", "00CN", "00DN", "00FB", "00FC", "00FD", "00FE", "00FF", "0NNN",
+    "1NNN", "2NNN", "3XNN", "4XNN", "5XY0", "6XNN", "7XNN",
+    "8XY0", "8XY1", "8XY2", "8XY3", "8XY4", "8XY5", "8XY6", "8XY7", "8XYE",
+    "9XY0", "ANNN", "BNNN", "CXNN", "DXYN",
+    "EX9E", "EXA1",
+    "FN01", "FX07", "FX0A", "FX15", "FX18", "FX1E", "FX29", "FX33", "FX55", "FX65",
+    "invalid",
 };
+
+// Classify opcode by its final handler from decode_opcode, e.g. for profiling. Opcodes the
+// extension doesn't implement dispatch to instr_NOP and count as invalid
+opcode_class_t opcode_class(instruction_func_t handler, uint16_t opcode)
+{
+    if (handler == instr_NOP)
+        return OP_INVALID;
+
+    const uint8_t N = opcode & 0x0F;
+    const uint8_t NN = opcode & 0xFF;
+
+    switch ((opcode >> 12) & 0x0F)
+    {
+    case 0x0:
+        if (opcode == 0x00E0) return OP_00E0;
+        if (opcode == 0x00EE) return OP_00EE;
+        if ((opcode & 0xFFF0) == 0x00C0) return OP_00CN;
+        if ((opcode & 0xFFF0) == 0x00D0) return OP_00DN;
+        if (opcode >= 0x00FB && opcode <= 0x00FF) return (opcode_class_t)(OP_00FB + (opcode - 0x00FB));
+        return OP_0NNN;
+    case 0x1: return OP_1NNN;
+    case 0x2: return OP_2NNN;
+    case 0x3: return OP_3XNN;
+    case 0x4: return OP_4XNN;
+    case 0x5: return N == 0 ? OP_5XY0 : OP_INVALID;
+    case 0x6: return OP_6XNN;
+    case 0x7: return OP_7XNN;
+    case 0x8:
+        if (N <= 0x7) return (opcode_class_t)(OP_8XY0 + N);
+        return N == 0xE ? OP_8XYE : OP_INVALID;
+    case 0x9: return N == 0 ? OP_9XY0 : OP_INVALID;
+    case 0xA: return OP_ANNN;
+    case 0xB: return OP_BNNN;
+    case 0xC: return OP_CXNN;
+    case 0xD: return OP_DXYN;
+    case 0xE:
+        if (NN == 0x9E) return OP_EX9E;
+        if (NN == 0xA1) return OP_EXA1;
+        return OP_INVALID;
+    default:
+        switch (NN)
+        {
+        case 0x01: return OP_FN01;
+        case 0x07: return OP_FX07;
+        case 0x0A: return OP_FX0A;
+        case 0x15: return OP_FX15;
+        case 0x18: return OP_FX18;
+        case 0x1E: return OP_FX1E;
+        case 0x29: return OP_FX29;
+        case 0x33: return OP_FX33;
+        case 0x55: return OP_FX55;
+        case 0x65: return OP_FX65;
+        default: return OP_INVALID;
+        }
+    }
+}
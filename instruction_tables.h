@@ -2,14 +2,39 @@
 #define INSTRUCTION_TABLES_H
 
 #include "chip8.h"
+#include "app.h"
 
-typedef void (*instruction_func_t)(chip8_t *chip8, const config_t *config);
+// Every final handler an opcode can end up in, after sub table dispatch
+enum opcode_class
+{
+    OP_00E0 = 0, OP_00EE, OP_00CN, OP_00DN, OP_00FB, OP_00FC, OP_00FD, OP_00FE, OP_00FF, OP_0NNN,
+    OP_1NNN, OP_2NNN, OP_3XNN, OP_4XNN, OP_5XY0, OP_6XNN, OP_7XNN,
+    OP_8XY0, OP_8XY1, OP_8XY2, OP_8XY3, OP_8XY4, OP_8XY5, OP_8XY6, OP_8XY7, OP_8XYE,
+    OP_9XY0, OP_ANNN, OP_BNNN, OP_CXNN, OP_DXYN,
+    OP_EX9E, OP_EXA1,
+    OP_FN01, OP_FX07, OP_FX0A, OP_FX15, OP_FX18, OP_FX1E, OP_FX29, OP_FX33, OP_FX55, OP_FX65,
+    OP_INVALID,
+    NUM_OPCODE_CLASSES,
+};
+
+// Handler tables of one extension, quirks already folded into the handlers
+struct handler_table
+{
+    instruction_func_t opcode_table[16];
+    instruction_func_t table_0NNN[0x100];
+    instruction_func_t table_8XYN[16];
+    instruction_func_t table_EXNN[0x100];
+    instruction_func_t table_FXNN[0x100];
+};
 
 // --- Declarations (no actual data here) ---
-extern instruction_func_t opcode_table[16];
-extern instruction_func_t table_0NNN[0x100];
-extern instruction_func_t table_8XYN[16];
-extern instruction_func_t table_EXNN[0x100];
-extern instruction_func_t table_FXNN[0x100];
+extern const handler_table_t handler_tables[NUM_EXTENSIONS];
+
+// Resolve opcode to its final handler in the given tables, walking the sub tables once
+instruction_func_t decode_opcode(const handler_table_t *handlers, uint16_t opcode);
+
+// Classify opcode by the handler decode_opcode resolved it to, e.g. for profiling
+opcode_class_t opcode_class(instruction_func_t handler, uint16_t opcode);
+extern const char *opcode_class_names[NUM_OPCODE_CLASSES];
 
 #endif
\ No newline at end of file
@@ -0,0 +1,409 @@
+// mmap flags for anonymous executable memory are POSIX extensions
+#define _DEFAULT_SOURCE
+
+#include <string.h>
+
+#include "jit.h"
+#include "chip8.h"
+#include "instruction_tables.h"
+#include "exec_trace.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define JIT_SUPPORTED 1
+#endif
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
+
+// Worst case native bytes for one block: prologue/epilogue plus the longest per instruction sequence
+#define JIT_MAX_BLOCK_BYTES (JIT_MAX_BLOCK_INSTS * 48 + 64)
+
+// Fallback calls store the whole decoded instruction with one 64 bit move
+_Static_assert(sizeof(instruction_t) == 8, "instruction_t must pack into 8 bytes");
+
+bool init_jit(jit_t *jit)
+{
+    memset(jit, 0, sizeof(jit_t));
+
+#ifndef JIT_SUPPORTED
+    fprintf(stderr, "JIT is only supported on x86-64, using interpreter\n");
+    return false;
+#else
+#if defined(_WIN32)
+    jit->code_buffer = VirtualAlloc(NULL, JIT_CODE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+    jit->code_buffer = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit->code_buffer == MAP_FAILED)
+        jit->code_buffer = NULL;
+#endif
+    if (!jit->code_buffer)
+    {
+        fprintf(stderr, "Could not allocate executable memory for JIT, using interpreter\n");
+        return false;
+    }
+
+    return true;
+#endif
+}
+
+void destroy_jit(jit_t *jit)
+{
+    if (!jit->code_buffer)
+        return;
+
+#if defined(_WIN32)
+    VirtualFree(jit->code_buffer, 0, MEM_RELEASE);
+#else
+    munmap(jit->code_buffer, JIT_CODE_SIZE);
+#endif
+    jit->code_buffer = NULL;
+}
+
+// Drop every translated block and reuse the code buffer from the start
+void jit_flush(jit_t *jit)
+{
+    memset(jit->blocks, 0, sizeof(jit->blocks));
+    memset(jit->hits, 0, sizeof(jit->hits));
+    memset(jit->covered, 0, sizeof(jit->covered));
+    jit->code_used = 0;
+    jit->generation++;
+}
+
+// Drop translated blocks overlapping written ram
+void jit_invalidate(jit_t *jit, uint16_t address, uint16_t length)
+{
+    // Rewriting most of ram (e.g. rom reload) is cheaper to handle with a flush
+    if ((uint32_t)address + length >= sizeof(jit->blocks) / sizeof(jit->blocks[0]))
+    {
+        jit_flush(jit);
+        return;
+    }
+
+    // Data writes away from translated code are the common case
+    bool hit = false;
+    for (uint32_t i = address; i < (uint32_t)address + length && !hit; i++)
+        hit = jit->covered[i];
+    if (!hit)
+        return;
+
+    // Blocks starting up to one maximum block length before the write may cover it
+    const int32_t first = (int32_t)address - JIT_MAX_BLOCK_INSTS * 2;
+    for (int32_t start = first < 0 ? 0 : first; start < address + length; start++)
+    {
+        jit_block_t *block = &jit->blocks[start];
+        if (block->code && start + block->length > address)
+            block->code = NULL;
+    }
+}
+
+#ifdef JIT_SUPPORTED
+
+// x86-64 code emitters, chip8 pointer lives in rbx and config pointer in r12
+static void emit8(uint8_t **p, uint8_t value) { *(*p)++ = value; }
+static void emit16(uint8_t **p, uint16_t value) { memcpy(*p, &value, sizeof(value)); *p += sizeof(value); }
+static void emit32(uint8_t **p, uint32_t value) { memcpy(*p, &value, sizeof(value)); *p += sizeof(value); }
+static void emit64(uint8_t **p, uint64_t value) { memcpy(*p, &value, sizeof(value)); *p += sizeof(value); }
+
+// ModRM for [rbx + disp32] with reg field
+static void emit_rbx_disp(uint8_t **p, uint8_t reg, uint32_t disp)
+{
+    emit8(p, (uint8_t)(0x80 | (reg << 3) | 3));
+    emit32(p, disp);
+}
+
+static uint32_t offset_V(uint8_t reg) { return (uint32_t)(offsetof(chip8_t, V) + reg); }
+
+static void emit_prologue(uint8_t **p)
+{
+    emit8(p, 0x53);                                         // push rbx
+    emit8(p, 0x41); emit8(p, 0x54);                         // push r12
+    emit8(p, 0x41); emit8(p, 0x55);                         // push r13 (keeps stack 16 byte aligned)
+    emit8(p, 0x48); emit8(p, 0x83); emit8(p, 0xEC); emit8(p, 0x20); // sub rsp, 32 (Win64 shadow space)
+#if defined(_WIN32)
+    emit8(p, 0x48); emit8(p, 0x89); emit8(p, 0xCB);         // mov rbx, rcx
+    emit8(p, 0x49); emit8(p, 0x89); emit8(p, 0xD4);         // mov r12, rdx
+#else
+    emit8(p, 0x48); emit8(p, 0x89); emit8(p, 0xFB);         // mov rbx, rdi
+    emit8(p, 0x49); emit8(p, 0x89); emit8(p, 0xF4);         // mov r12, rsi
+#endif
+}
+
+static void emit_epilogue(uint8_t **p)
+{
+    emit8(p, 0x48); emit8(p, 0x83); emit8(p, 0xC4); emit8(p, 0x20); // add rsp, 32
+    emit8(p, 0x41); emit8(p, 0x5D);                         // pop r13
+    emit8(p, 0x41); emit8(p, 0x5C);                         // pop r12
+    emit8(p, 0x5B);                                         // pop rbx
+    emit8(p, 0xC3);                                         // ret
+}
+
+// mov word [rbx + PC], address
+static void emit_store_pc(uint8_t **p, uint16_t address)
+{
+    emit8(p, 0x66); emit8(p, 0xC7);
+    emit_rbx_disp(p, 0, (uint32_t)offsetof(chip8_t, PC));
+    emit16(p, address);
+}
+
+// al = VY; <op> VX, al
+static void emit_alu_VX_VY(uint8_t **p, uint8_t op, uint8_t X, uint8_t Y)
+{
+    emit8(p, 0x8A); emit_rbx_disp(p, 0, offset_V(Y));       // mov al, VY
+    emit8(p, op); emit_rbx_disp(p, 0, offset_V(X));         // op VX, al
+}
+
+// al = VX; <op> al, VY; set<cc> cl; VX = al; VF = cl
+static void emit_arith_flag(uint8_t **p, uint8_t op, uint8_t setcc, uint8_t X, uint8_t Y)
+{
+    emit8(p, 0x8A); emit_rbx_disp(p, 0, offset_V(X));       // mov al, VX
+    emit8(p, op); emit_rbx_disp(p, 0, offset_V(Y));         // add/sub al, VY
+    emit8(p, 0x0F); emit8(p, setcc); emit8(p, 0xC1);        // setc/setnc cl
+    emit8(p, 0x88); emit_rbx_disp(p, 0, offset_V(X));       // mov VX, al
+    emit8(p, 0x88); emit_rbx_disp(p, 1, offset_V(0xF));     // mov VF, cl
+}
+
+// Run the interpreter handler for one instruction: chip8->inst = inst; chip8->PC = next; handler(chip8, config)
+static void emit_call(uint8_t **p, const instruction_t *inst, uint16_t next, instruction_func_t handler)
+{
+    uint64_t packed;
+    memcpy(&packed, inst, sizeof(packed));
+
+    emit8(p, 0x48); emit8(p, 0xB8); emit64(p, packed);      // movabs rax, inst
+    emit8(p, 0x48); emit8(p, 0x89);
+    emit_rbx_disp(p, 0, (uint32_t)offsetof(chip8_t, inst)); // mov [rbx + inst], rax
+    emit_store_pc(p, next);
+#if defined(_WIN32)
+    emit8(p, 0x48); emit8(p, 0x89); emit8(p, 0xD9);         // mov rcx, rbx
+    emit8(p, 0x4C); emit8(p, 0x89); emit8(p, 0xE2);         // mov rdx, r12
+#else
+    emit8(p, 0x48); emit8(p, 0x89); emit8(p, 0xDF);         // mov rdi, rbx
+    emit8(p, 0x4C); emit8(p, 0x89); emit8(p, 0xE6);         // mov rsi, r12
+#endif
+    emit8(p, 0x48); emit8(p, 0xB8); emit64(p, (uint64_t)(uintptr_t)handler); // movabs rax, handler
+    emit8(p, 0xFF); emit8(p, 0xD0);                         // call rax
+}
+
+// Opcodes that change PC or may rewrite code end the block after running
+static bool ends_block(uint16_t opcode)
+{
+    switch ((opcode >> 12) & 0x0F)
+    {
+    case 0x1: case 0x2: case 0x3: case 0x4:
+    case 0x5: case 0x9: case 0xB: case 0xE:
+        return true;
+    case 0x0:
+        return opcode == 0x00EE || opcode == 0x00FD;
+    case 0xF:
+        return (opcode & 0xFF) == 0x0A || (opcode & 0xFF) == 0x33 || (opcode & 0xFF) == 0x55;
+    default:
+        return false;
+    }
+}
+
+static void translate_block(jit_t *jit, const chip8_t *chip8, const config_t *config, uint16_t start)
+{
+    // An opcode at 0xFFF wraps to ram[0], an empty block would never advance PC. Left to the interpreter
+    if (start + 1u >= sizeof(chip8->ram))
+        return;
+
+    if (JIT_CODE_SIZE - jit->code_used < JIT_MAX_BLOCK_BYTES)
+        jit_flush(jit);
+
+    uint8_t *code = jit->code_buffer + jit->code_used;
+    uint8_t *p = code;
+    uint16_t address = start;
+    uint16_t num_insts = 0;
+    bool pc_synced = false;
+    bool done = false;
+
+    emit_prologue(&p);
+
+    while (!done && num_insts < JIT_MAX_BLOCK_INSTS && address + 1u < sizeof(chip8->ram))
+    {
+        const uint16_t opcode = (chip8->ram[address] << 8) | chip8->ram[address + 1];
+        const instruction_t inst = {
+            .opcode = opcode,
+            .NNN = opcode & 0xFFF,
+            .NN = opcode & 0x0FF,
+            .N = opcode & 0x0F,
+            .X = (opcode >> 8) & 0x0F,
+            .Y = (opcode >> 4) & 0x0F,
+        };
+        const uint16_t next = address + 2;
+        bool native = true;
+
+        switch ((opcode >> 12) & 0x0F)
+        {
+        case 0x1:
+            // 0x1NNN: Jump, block ends here. Idle loops go through the handler so they flag chip8->idle
+            if (chip8_idle_jump(chip8, address, inst.NNN))
+                native = false;
+            else
+                emit_store_pc(&p, inst.NNN);
+            break;
+        case 0x6:
+            // 0x6XNN: mov byte VX, NN
+            emit8(&p, 0xC6); emit_rbx_disp(&p, 0, offset_V(inst.X)); emit8(&p, inst.NN);
+            break;
+        case 0x7:
+            // 0x7XNN: add byte VX, NN
+            emit8(&p, 0x80); emit_rbx_disp(&p, 0, offset_V(inst.X)); emit8(&p, inst.NN);
+            break;
+        case 0x8:
+            switch (inst.N)
+            {
+            case 0x0:
+                emit8(&p, 0x8A); emit_rbx_disp(&p, 0, offset_V(inst.Y)); // mov al, VY
+                emit8(&p, 0x88); emit_rbx_disp(&p, 0, offset_V(inst.X)); // mov VX, al
+                break;
+            case 0x1:
+            case 0x2:
+            case 0x3:
+            {
+                const uint8_t ops[] = {0x08, 0x20, 0x30}; // or, and, xor
+                emit_alu_VX_VY(&p, ops[inst.N - 1], inst.X, inst.Y);
+                if (config->current_extension == CHIP8)
+                {
+                    emit8(&p, 0xC6); emit_rbx_disp(&p, 0, offset_V(0xF)); emit8(&p, 0); // Chip-8 ONLY QUIRK
+                }
+                break;
+            }
+            case 0x4:
+                emit_arith_flag(&p, 0x02, 0x92, inst.X, inst.Y); // add, setc
+                break;
+            case 0x5:
+                emit_arith_flag(&p, 0x2A, 0x93, inst.X, inst.Y); // sub, setnc
+                break;
+            default:
+                native = false;
+                break;
+            }
+            break;
+        case 0xA:
+            // 0xANNN: mov word I, NNN
+            emit8(&p, 0x66); emit8(&p, 0xC7);
+            emit_rbx_disp(&p, 0, (uint32_t)offsetof(chip8_t, I));
+            emit16(&p, inst.NNN);
+            break;
+        default:
+            native = false;
+            break;
+        }
+
+        if (native)
+        {
+            pc_synced = ((opcode >> 12) & 0x0F) == 0x1;
+        }
+        else
+        {
+            // Not covered yet, call the interpreter handler
+            const instruction_func_t handler = decode_opcode(chip8->handlers, opcode);
+            if (handler != instr_NOP)
+                emit_call(&p, &inst, next, handler);
+            pc_synced = handler != instr_NOP;
+        }
+
+        done = ends_block(opcode);
+        num_insts++;
+        address = next;
+    }
+
+    if (!pc_synced)
+        emit_store_pc(&p, address);
+    emit_epilogue(&p);
+
+    jit->code_used += (size_t)(p - code);
+    memset(&jit->covered[start], true, address - start);
+    jit->blocks[start] = (jit_block_t){
+        .code = (jit_block_func_t)(uintptr_t)code,
+        .length = address - start,
+        .num_insts = num_insts,
+    };
+}
+
+#endif
+
+// One dispatch: a whole translated block when it fits in num_insts, else one interpreted instruction.
+// Returns instructions executed
+static inline uint32_t dispatch(jit_t *jit, chip8_t *chip8, const config_t *config, uint32_t num_insts)
+{
+    // Drop blocks covering ram written by FX33/FX55 or a freshly loaded rom
+    if (chip8->written_hi)
+    {
+        jit_invalidate(jit, chip8->written_lo, chip8->written_hi - chip8->written_lo);
+        chip8->written_lo = 0xFFFF;
+        chip8->written_hi = 0;
+    }
+
+    const uint16_t address = chip8->PC & 0xFFF;
+    jit_block_t *block = &jit->blocks[address];
+
+#ifdef JIT_SUPPORTED
+    if (!block->code && jit->code_buffer && ++jit->hits[address] >= JIT_HOT_THRESHOLD)
+    {
+        jit->hits[address] = 0;
+        translate_block(jit, chip8, config, address);
+    }
+#endif
+
+    // Only run whole blocks that fit in the remaining budget
+    if (block->code && block->num_insts <= num_insts)
+    {
+        if (!chip8->trace)
+        {
+            block->code(chip8, config);
+            return block->num_insts;
+        }
+
+        // One record for the whole block, keyed by its first instruction
+        const uint16_t opcode = (uint16_t)(chip8->ram[address] << 8 | chip8->ram[(address + 1) & 0xFFF]);
+        const instruction_t first = {
+            .opcode = opcode,
+            .X = (uint8_t)((opcode >> 8) & 0x0F),
+            .Y = (uint8_t)((opcode >> 4) & 0x0F),
+        };
+        trace_record_t *record = trace_begin(chip8->trace, chip8, address, &first, TRACE_BLOCK,
+                                             (uint16_t)block->num_insts);
+        block->code(chip8, config);
+        trace_end(chip8->trace, record, chip8, first.X);
+        return block->num_insts;
+    }
+
+    emulate_instruction(chip8, config);
+    return 1;
+}
+
+// Run up to num_insts CHIP8 instructions, using translated blocks for hot code. Stops early when idle
+uint32_t jit_run(jit_t *jit, chip8_t *chip8, const config_t *config, uint32_t num_insts)
+{
+    // Blocks can't stop half way, breakpoints need the interpreter
+    if (chip8->breakpoints)
+        return chip8_step(chip8, config, num_insts);
+
+    uint32_t executed = 0;
+    chip8->idle = false;
+
+    // Blocks bake in extension quirks
+    if (config->current_extension != jit->extension)
+    {
+        jit_flush(jit);
+        jit->extension = config->current_extension;
+    }
+
+    while (executed < num_insts && !(chip8->idle && config->skip_idle))
+        executed += dispatch(jit, chip8, config, num_insts - executed);
+
+    return executed;
+}
+
+// Single dispatch of jit_run with num_insts left in its budget, steps through hot code a block at a time
+uint32_t jit_step(jit_t *jit, chip8_t *chip8, const config_t *config, uint32_t num_insts)
+{
+    return dispatch(jit, chip8, config, num_insts);
+}
@@ -0,0 +1,43 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "type_defs.h"
+#include "app.h"
+
+#define JIT_CODE_SIZE (1024 * 1024)  // Bytes of executable memory for translated blocks
+#define JIT_MAX_BLOCK_INSTS 64       // Longest straight line run translated into one block
+#define JIT_HOT_THRESHOLD 16         // Interpreted visits before an address gets translated
+
+typedef void (*jit_block_func_t)(chip8_t *chip8, const config_t *config);
+
+// Native code for a CHIP8 basic block starting at some address
+struct jit_block
+{
+    jit_block_func_t code;      // Translated code, NULL if not translated
+    uint16_t length;            // Bytes of CHIP8 ram covered by the block
+    uint16_t num_insts;         // CHIP8 instructions executed by one run of the block
+};
+
+struct jit
+{
+    uint8_t *code_buffer;           // Executable memory
+    size_t code_used;               // Bytes of code_buffer handed out so far
+    jit_block_t blocks[4096];       // Translated blocks indexed by start address
+    uint8_t hits[4096];             // Visits to not yet translated addresses
+    bool covered[4096];             // Ram bytes inside some translated block
+    extension_t extension;          // Extension blocks were translated for
+    uint32_t generation;            // Bumped by every flush, older block pointers may see overwritten code
+};
+
+bool init_jit(jit_t *jit);
+uint32_t jit_run(jit_t *jit, chip8_t *chip8, const config_t *config, uint32_t num_insts);
+uint32_t jit_step(jit_t *jit, chip8_t *chip8, const config_t *config, uint32_t num_insts);
+void jit_invalidate(jit_t *jit, uint16_t address, uint16_t length);
+void jit_flush(jit_t *jit);
+void destroy_jit(jit_t *jit);
+
+#endif
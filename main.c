@@ -1,9 +1,260 @@
-#include <time.h>
+#include <string.h>
 #include <SDL3/SDL.h>
 
 #include "app.h"
 #include "chip8.h"
 #include "sdl.h"
+#include "fade.h"
+#include "jit.h"
+#include "state.h"
+#include "stats.h"
+#include "capture.h"
+#include "threads.h"
+#include "gdb.h"
+#include "exec_trace.h"
+
+// Everything the emulation thread owns, the render thread only sees commands and triple buffer
+typedef struct emulator
+{
+    chip8_t chip8;
+    config_t config;            // Own copy, hotkeys change it through the command queue
+    sdl_t *sdl;                 // Audio stream and frame event type only
+    jit_t jit;
+    bool use_jit;
+    rewind_t *rewind;           // Rewind history, NULL if it could not be allocated
+    capture_t capture;
+    bool recording;
+    gdb_t *gdb;                 // Debug stub, NULL unless --gdb
+    trace_t trace;              // Execution trace ring, chip8.trace points here while tracing
+    fade_t fade;                // Phosphor fade state of pixel_color
+    uint64_t version;           // Bumped whenever pixel_color changed
+    uint64_t published_version; // What the last frame handed to the render thread showed
+    bool published_hires;
+    bool published_turbo;
+    double published_speed;
+    command_queue_t commands;   // Render thread to emulation thread
+    command_t keys[COMMAND_QUEUE_SIZE]; // Key events waiting for their place in the next slice
+    uint32_t num_keys;
+    uint64_t slice_ns;          // SDL_GetTicksNS() when the last slice ran, start of the next one's input window
+    triple_buffer_t frames;     // Emulation thread to render thread
+} emulator_t;
+
+static uint32_t run_insts(emulator_t *emu, uint32_t num_insts)
+{
+    if (emu->use_jit)
+        return jit_run(&emu->jit, &emu->chip8, &emu->config, num_insts);
+    return chip8_step(&emu->chip8, &emu->config, num_insts);
+}
+
+// Key events not tied to a slice (paused, rewinding, turbo), applied right away in order
+static void apply_keys(emulator_t *emu)
+{
+    for (uint32_t i = 0; i < emu->num_keys; i++)
+        chip8_set_key(&emu->chip8, (uint8_t)emu->keys[i].value, emu->keys[i].type == CMD_KEY_DOWN);
+    emu->num_keys = 0;
+}
+
+// Run one slice of the frame's batch. The slice stands for the wall time since the previous one, each
+// key event is applied at the instruction matching its timestamp in there, so a press and release
+// inside one frame are both seen. An idle rom skips ahead to the next key event
+static uint32_t run_slice(emulator_t *emu, uint32_t num_insts)
+{
+    chip8_t *chip8 = &emu->chip8;
+    const uint64_t start = emu->slice_ns;
+    const uint64_t end = SDL_GetTicksNS();
+    const uint64_t span = end > start ? end - start : 1;
+    emu->slice_ns = end;
+
+    uint32_t pressed_at[NUM_KEYS];
+    memset(pressed_at, 0xFF, sizeof(pressed_at));
+
+    uint32_t done = 0;
+    uint32_t executed = 0;
+    for (uint32_t i = 0; i <= emu->num_keys; i++)
+    {
+        const command_t *key = i < emu->num_keys ? &emu->keys[i] : NULL;
+        uint32_t at = num_insts;
+        if (key)
+        {
+            const uint8_t k = (uint8_t)(key->value & 0x0F);
+            if (key->timestamp <= start)
+                at = 0;
+            else if (key->timestamp < end)
+                at = (uint32_t)((key->timestamp - start) * num_insts / span);
+
+            // In order, and a tap stays down for at least one instruction
+            if (at < done)
+                at = done;
+            if (key->type == CMD_KEY_UP && pressed_at[k] != UINT32_MAX && at <= pressed_at[k] && at < num_insts)
+                at = pressed_at[k] + 1;
+            if (key->type == CMD_KEY_DOWN)
+                pressed_at[k] = at;
+        }
+
+        if (at > done)
+        {
+            const uint32_t ran = run_insts(emu, at - done);
+            executed += ran;
+            done = chip8->idle ? at : done + ran; // Nothing changes until the event
+        }
+        if (key)
+            chip8_set_key(chip8, (uint8_t)key->value, key->type == CMD_KEY_DOWN);
+    }
+
+    emu->num_keys = 0;
+    return executed;
+}
+
+// Fade one frame and hand it to the render thread, pixels only copied when they changed
+static void publish_frame(emulator_t *emu, bool turbo, double insts_per_second)
+{
+    chip8_t *chip8 = &emu->chip8;
+    if (fade_update(&emu->fade, chip8, &emu->config))
+        emu->version++;
+
+    // Nothing visible changed, the render thread keeps its last frame and stays asleep
+    if (emu->version == emu->published_version && chip8->hires == emu->published_hires &&
+        turbo == emu->published_turbo && insts_per_second == emu->published_speed)
+        return;
+    emu->published_version = emu->version;
+    emu->published_hires = chip8->hires;
+    emu->published_turbo = turbo;
+    emu->published_speed = insts_per_second;
+
+    render_frame_t *frame = triple_buffer_back(&emu->frames);
+    if (frame->version != emu->version)
+    {
+        memcpy(frame->pixel_color, chip8->pixel_color, sizeof(frame->pixel_color));
+        frame->version = emu->version;
+    }
+    frame->hires = chip8->hires;
+    frame->turbo = turbo;
+    frame->insts_per_second = insts_per_second;
+    triple_buffer_publish(&emu->frames);
+
+    SDL_Event event = {.type = emu->sdl->frame_event};
+    SDL_PushEvent(&event);
+}
+
+// CPU, timers, audio and recording at 60hz, never held up by presents on the render thread
+static int SDLCALL emulation_thread(void *data)
+{
+    emulator_t *emu = data;
+    chip8_t *chip8 = &emu->chip8;
+    config_t *config = &emu->config;
+
+    // 60hz frame deadlines, covering emulation, audio and publishing frames
+    frame_clock_t frame_clock;
+    init_frame_clock(&frame_clock);
+
+    // Instructions run since the title was last updated, for the turbo speed readout
+    uint64_t title_insts = 0;
+    uint32_t title_frames = 0;
+    double insts_per_second = 0;
+
+    emu->slice_ns = SDL_GetTicksNS();
+
+    // Emulation loop
+    while (chip8->state != QUIT)
+    {
+        // Halted by the debugger, serve it until it resumes. Commands still apply so the window can quit
+        if (emu->gdb && gdb_serve(emu->gdb, chip8, config, 0))
+        {
+            while (chip8->state != QUIT && gdb_serve(emu->gdb, chip8, config, GDB_POLL_MS))
+                handle_commands(chip8, config, &emu->commands, NULL, NULL);
+            init_frame_clock(&frame_clock); // Start over instead of counting the halt as late frames
+            emu->slice_ns = SDL_GetTicksNS();
+        }
+
+        // Apply hotkeys from the render thread, key events wait for their slice
+        handle_commands(chip8, config, &emu->commands, emu->keys, &emu->num_keys);
+        handle_audio(emu->sdl, chip8, config);
+        if (chip8->state != RUNNING || config->turbo)
+            apply_keys(emu);
+
+        if (chip8->state != PAUSED)
+        {
+            // Emulate Chip-8 instructions for this emulator "frame" (60hz), or step back one frame
+            if (chip8->state == REWINDING)
+            {
+                if (!emu->rewind || !rewind_pop(emu->rewind, chip8))
+                    chip8->state = RUNNING; // Out of history
+            }
+            else if (!config->turbo)
+            {
+                // Batch spread over the frame in slices, new key events picked up before each one
+                const uint32_t num_insts = frame_clock_insts(&frame_clock, config->insts_per_second);
+                for (uint32_t slice = 0; slice < FRAME_SLICES && chip8->state == RUNNING && !config->turbo; slice++)
+                {
+                    if (slice)
+                    {
+                        wait_frame_slice(&frame_clock, slice);
+                        handle_commands(chip8, config, &emu->commands, emu->keys, &emu->num_keys);
+                    }
+                    title_insts += run_slice(emu, num_insts * (slice + 1) / FRAME_SLICES - num_insts * slice / FRAME_SLICES);
+                }
+                apply_keys(emu); // Left over when a command stopped the slices
+
+                if (emu->rewind)
+                    rewind_push(emu->rewind, chip8);
+
+                // Update delay and sound timers every 60hz of emulated time
+                update_timers(chip8);
+                STATS_INC(chip8, frames);
+            }
+            else
+            {
+                // Turbo runs several emulated frames per displayed one, timers still tick every emulated frame
+                uint32_t frames = 0;
+                do
+                {
+                    title_insts += run_insts(emu, frame_clock_insts(&frame_clock, config->insts_per_second));
+
+                    if (emu->rewind)
+                        rewind_push(emu->rewind, chip8);
+
+                    // Update delay and sound timers every 60hz of emulated time
+                    update_timers(chip8);
+                    STATS_INC(chip8, frames);
+                    frames++;
+                } while (config->turbo && (config->turbo_speed ? frames < config->turbo_speed
+                                                               : frame_clock_remaining_ns(&frame_clock) > FRAME_SPIN_NS));
+            }
+
+            STATS_ADD(chip8, draw_frames, chip8->draw);
+
+            // Hand the frame to the render thread every 60hz
+            publish_frame(emu, config->turbo, insts_per_second);
+            chip8->draw = false;
+        }
+
+        // One recorded frame per 60hz tick, paused ones included so the recording keeps real time
+        if (emu->recording)
+            capture_push(&emu->capture, chip8);
+
+        // Turbo speed for the title once a second
+        if (++title_frames == FRAMES_PER_SECOND)
+        {
+            insts_per_second = (double)title_insts * FRAMES_PER_SECOND / title_frames;
+            title_insts = 0;
+            title_frames = 0;
+        }
+
+        // Idle rom or paused, block on the command queue instead of sleeping so key presses land right away
+        if ((chip8->idle && !config->turbo) || chip8->state == PAUSED)
+        {
+            while (chip8->state != QUIT && wait_frame_command(&frame_clock, &emu->commands))
+                handle_commands(chip8, config, &emu->commands, emu->keys, &emu->num_keys);
+        }
+
+        // Sleep out the rest of the frame, paused frames included so pause does not spin
+        const uint32_t missed = wait_frame_clock(&frame_clock);
+        STATS_ADD(chip8, late_frames, missed > 0);
+        STATS_ADD(chip8, dropped_frames, missed > 1 ? missed - 1 : 0);
+    }
+
+    return 0;
+}
 
 int main(int argc, char **argv)
 {
@@ -27,54 +278,127 @@ int main(int argc, char **argv)
     if (!init_sdl(&sdl, &config))
         exit(EXIT_FAILURE);
 
-    chip8_t chip8 = {0};
+    // Large, kept off the stack
+    emulator_t *emu = calloc(1, sizeof(emulator_t));
+    if (!emu)
+        exit(EXIT_FAILURE);
+    emu->config = config;
+    emu->sdl = &sdl;
+
+    chip8_t *chip8 = &emu->chip8;
     const char *rom_name = argv[1];
-    
-    if (!init_chip8(&chip8, &config, rom_name))
+
+    if (!init_chip8(chip8, &emu->config, rom_name))
         exit(EXIT_FAILURE);
 
-    // Initial screen clear to background color
-    clear_screen(sdl, &config);
+#ifdef CHIP8_STATS
+    // Counters survive '*' resets, dumped on F3 and at exit
+    static chip8_stats_t stats;
+    chip8->stats = &stats;
+#endif
 
-    // Seed random number generator
-    srand((uint32_t)time(NULL));
+    // Optional JIT, falls back to interpreter if not available
+    emu->use_jit = config.use_jit && init_jit(&emu->jit);
 
-    // Main emulator loop
-    while (chip8.state != QUIT)
+    // Rewind history, emulator still runs without it
+    emu->rewind = malloc(sizeof(rewind_t));
+    if (emu->rewind && !init_rewind(emu->rewind))
     {
-        // Handle user input
-        handle_input(&chip8, &config);
-        handle_audio(&chip8, &config, sdl.stream);
-        
-        if(chip8.state == PAUSED) continue;
+        free(emu->rewind);
+        emu->rewind = NULL;
+    }
 
-        // get_time() before running instructions;
-        const uint64_t start_frame_time = SDL_GetPerformanceCounter();
+    // Display recording, encoded and written on its own thread
+    emu->recording = config.record_path && init_capture(&emu->capture, &config, config.record_path, config.record_scale);
 
-        // Emulate Chip-8 instructions for this emulator "frame" (60hz)
-        for(uint32_t i = 0; i < config.insts_per_second / 60; i++)
-            emulate_instruction(&chip8, &config);
+    // Debug stub, the rom runs until a debugger attaches
+    if (config.gdb_address)
+    {
+        emu->gdb = malloc(sizeof(gdb_t));
+        if (!emu->gdb || !init_gdb(emu->gdb, config.gdb_address))
+            exit(EXIT_FAILURE);
+    }
 
-        // get_time() elapsed after running instructions;
-        const uint64_t end_frame_time = SDL_GetPerformanceCounter();
+    // Execution trace, the rom still runs without one
+    if (config.trace)
+    {
+        char trace_path[1024];
+        if (!config.trace_path)
+            snprintf(trace_path, sizeof(trace_path), "%s.trace", rom_name);
+        if (trace_create(&emu->trace, config.trace_path ? config.trace_path : trace_path, TRACE_DEFAULT_RECORDS,
+                         config.current_extension))
+            chip8->trace = &emu->trace;
+    }
+
+    init_fade(&emu->fade);
+    emu->version = 1; // Frames start at version 0, so the first one is always uploaded
+    init_triple_buffer(&emu->frames);
+    if (!init_command_queue(&emu->commands))
+        exit(EXIT_FAILURE);
 
-        // Delay for approximately 60hz/60fps (16.67ms) or actual time elapsed
-        const double time_elapsed =  (double)((end_frame_time - start_frame_time) * 1000) / SDL_GetPerformanceFrequency();
+    // Initial screen clear to background color
+    clear_screen(sdl, &config);
+
+    SDL_Thread *thread = SDL_CreateThread(emulation_thread, "emulation", emu);
+    if (!thread)
+    {
+        SDL_Log("Could not create emulation thread %s\n", SDL_GetError());
+        exit(EXIT_FAILURE);
+    }
 
-        SDL_Delay((uint32_t)(16.67f > time_elapsed ? 16.67f - time_elapsed : 0));
+    // Render loop, sleeps until input arrives or the emulation thread published a frame.
+    // The front frame stays ours until the next acquire, so exposes redraw it without a new one
+    bool title_turbo = config.turbo;
+    double title_speed = 0;
+    const render_frame_t *frame = NULL;
+    while (SDL_WaitEvent(NULL) && handle_input(&sdl, &emu->commands))
+    {
+        const render_frame_t *fresh = triple_buffer_acquire(&emu->frames);
+        if (fresh)
+            frame = fresh;
+        if (!frame)
+            continue;
 
-        if(chip8.draw) {
-            // Update window with changes every 60hz
-            update_screen(sdl, &config, &chip8);
-            chip8.draw = false;
+        // Turbo speed in the title, changes once a second at most
+        if (frame->turbo != title_turbo || (frame->turbo && frame->insts_per_second != title_speed))
+        {
+            update_title(&sdl, &config, frame);
+            title_turbo = frame->turbo;
+            title_speed = frame->insts_per_second;
         }
 
-        // Update delay and sound timers every 60hz
-        update_timers(&sdl, &chip8);
+        update_screen(&sdl, &config, frame);
     }
 
+    // Quit has to get through, the emulation thread drains the queue every frame
+    while (!command_push(&emu->commands, CMD_QUIT, 0))
+        SDL_Delay(1);
+    SDL_WaitThread(thread, NULL);
+
+#ifdef CHIP8_STATS
+    char stats_path[1024];
+    snprintf(stats_path, sizeof(stats_path), "%s.stats.json", rom_name);
+    chip8_stats_write_json(&stats, stats_path);
+#endif
+
     // Final cleanup
+    if (emu->rewind)
+    {
+        destroy_rewind(emu->rewind);
+        free(emu->rewind);
+    }
+    if (emu->recording)
+        destroy_capture(&emu->capture);
+    if (emu->gdb)
+    {
+        destroy_gdb(emu->gdb, chip8);
+        free(emu->gdb);
+    }
+    trace_close(&emu->trace);
+    destroy_jit(&emu->jit);
+    destroy_command_queue(&emu->commands);
+    free(emu);
     final_cleanup(sdl);
 
     exit(EXIT_SUCCESS);
-}
\ No newline at end of file
+}
@@ -0,0 +1,565 @@
+// clock_gettime and dirent are POSIX, thread affinity is a GNU extension on Linux
+#if defined(__linux__)
+#define _GNU_SOURCE
+#else
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "platform.h"
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#else
+#include <time.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#endif
+
+struct platform_thread
+{
+#if defined(_WIN32)
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+    platform_thread_func_t func;
+    void *arg;
+};
+
+struct platform_mutex
+{
+#if defined(_WIN32)
+    CRITICAL_SECTION lock;
+#else
+    pthread_mutex_t lock;
+#endif
+};
+
+uint64_t platform_now_ns(void)
+{
+#if defined(_WIN32)
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    if (!frequency.QuadPart)
+        QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static bool is_rom_name(const char *name)
+{
+    const char *dot = strrchr(name, '.');
+    if (!dot)
+        return false;
+
+    // CHIP8, SCHIP and XO-CHIP roms
+    const char *exts[] = {".ch8", ".sc8", ".xo8"};
+    for (size_t e = 0; e < sizeof(exts) / sizeof(exts[0]); e++)
+    {
+        size_t i = 0;
+        while (exts[e][i] && tolower((unsigned char)dot[i]) == exts[e][i])
+            i++;
+        if (!exts[e][i] && !dot[i])
+            return true;
+    }
+    return false;
+}
+
+static bool append_path(char ***paths, size_t *count, const char *path)
+{
+    char **grown = realloc(*paths, (*count + 1) * sizeof(char *));
+    if (!grown)
+        return false;
+    *paths = grown;
+
+    const size_t length = strlen(path) + 1;
+    (*paths)[*count] = malloc(length);
+    if (!(*paths)[*count])
+        return false;
+    memcpy((*paths)[*count], path, length);
+    (*count)++;
+    return true;
+}
+
+static int compare_paths(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+bool platform_find_roms(const char *path, char ***paths, size_t *count)
+{
+    const size_t first = *count;
+    char child[4096];
+
+#if defined(_WIN32)
+    const DWORD attributes = GetFileAttributesA(path);
+    if (attributes == INVALID_FILE_ATTRIBUTES)
+        return false;
+    if (!(attributes & FILE_ATTRIBUTE_DIRECTORY))
+        return append_path(paths, count, path);
+
+    WIN32_FIND_DATAA entry;
+    snprintf(child, sizeof(child), "%s\\*", path);
+    HANDLE find = FindFirstFileA(child, &entry);
+    if (find == INVALID_HANDLE_VALUE)
+        return false;
+
+    do
+    {
+        if (entry.cFileName[0] == '.')
+            continue;
+        snprintf(child, sizeof(child), "%s/%s", path, entry.cFileName);
+        if (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            platform_find_roms(child, paths, count);
+        else if (is_rom_name(entry.cFileName) && !append_path(paths, count, child))
+            break;
+    } while (FindNextFileA(find, &entry));
+    FindClose(find);
+#else
+    struct stat info;
+    if (stat(path, &info) != 0)
+        return false;
+    if (!S_ISDIR(info.st_mode))
+        return append_path(paths, count, path);
+
+    DIR *dir = opendir(path);
+    if (!dir)
+        return false;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)))
+    {
+        if (entry->d_name[0] == '.')
+            continue;
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        if (stat(child, &info) != 0)
+            continue;
+        if (S_ISDIR(info.st_mode))
+            platform_find_roms(child, paths, count);
+        else if (is_rom_name(entry->d_name) && !append_path(paths, count, child))
+            break;
+    }
+    closedir(dir);
+#endif
+
+    // Directory order is filesystem dependent, keep runs reproducible
+    qsort(*paths + first, *count - first, sizeof(char *), compare_paths);
+    return true;
+}
+
+void platform_free_roms(char **paths, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        free(paths[i]);
+    free(paths);
+}
+
+uint8_t *platform_read_file(const char *path, size_t *size)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return NULL;
+
+    fseek(file, 0, SEEK_END);
+    const long length = ftell(file);
+    rewind(file);
+
+    uint8_t *data = length > 0 ? malloc((size_t)length) : NULL;
+    if (data && fread(data, (size_t)length, 1, file) != 1)
+    {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+
+    *size = data ? (size_t)length : 0;
+    return data;
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI thread_entry(LPVOID arg)
+#else
+static void *thread_entry(void *arg)
+#endif
+{
+    platform_thread_t *thread = arg;
+    thread->func(thread->arg);
+    return 0;
+}
+
+platform_thread_t *platform_thread_start(platform_thread_func_t func, void *arg)
+{
+    platform_thread_t *thread = malloc(sizeof(platform_thread_t));
+    if (!thread)
+        return NULL;
+    thread->func = func;
+    thread->arg = arg;
+
+#if defined(_WIN32)
+    thread->handle = CreateThread(NULL, 0, thread_entry, thread, 0, NULL);
+    if (!thread->handle)
+#else
+    if (pthread_create(&thread->handle, NULL, thread_entry, thread) != 0)
+#endif
+    {
+        free(thread);
+        return NULL;
+    }
+    return thread;
+}
+
+void platform_thread_join(platform_thread_t *thread)
+{
+#if defined(_WIN32)
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#else
+    pthread_join(thread->handle, NULL);
+#endif
+    free(thread);
+}
+
+platform_mutex_t *platform_mutex_create(void)
+{
+    platform_mutex_t *mutex = malloc(sizeof(platform_mutex_t));
+    if (!mutex)
+        return NULL;
+
+#if defined(_WIN32)
+    InitializeCriticalSection(&mutex->lock);
+#else
+    if (pthread_mutex_init(&mutex->lock, NULL) != 0)
+    {
+        free(mutex);
+        return NULL;
+    }
+#endif
+    return mutex;
+}
+
+void platform_mutex_lock(platform_mutex_t *mutex)
+{
+#if defined(_WIN32)
+    EnterCriticalSection(&mutex->lock);
+#else
+    pthread_mutex_lock(&mutex->lock);
+#endif
+}
+
+void platform_mutex_unlock(platform_mutex_t *mutex)
+{
+#if defined(_WIN32)
+    LeaveCriticalSection(&mutex->lock);
+#else
+    pthread_mutex_unlock(&mutex->lock);
+#endif
+}
+
+void platform_mutex_destroy(platform_mutex_t *mutex)
+{
+    if (!mutex)
+        return;
+#if defined(_WIN32)
+    DeleteCriticalSection(&mutex->lock);
+#else
+    pthread_mutex_destroy(&mutex->lock);
+#endif
+    free(mutex);
+}
+
+// CPUs this process may run on, honours taskset/cgroup limits on Linux
+uint32_t platform_cpu_count(void)
+{
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors ? info.dwNumberOfProcessors : 1;
+#elif defined(__linux__)
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0)
+        return (uint32_t)CPU_COUNT(&set);
+    const long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (uint32_t)count : 1;
+#else
+    const long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (uint32_t)count : 1;
+#endif
+}
+
+// Pin calling thread to the index'th CPU it is allowed on, false where unsupported
+bool platform_pin_thread(uint32_t index)
+{
+#if defined(_WIN32)
+    const uint32_t cpu = index % platform_cpu_count();
+    if (cpu >= sizeof(DWORD_PTR) * 8)
+        return false;
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+#elif defined(__linux__)
+    cpu_set_t allowed, pinned;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0)
+        return false;
+
+    uint32_t skip = index % (uint32_t)CPU_COUNT(&allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (!CPU_ISSET(cpu, &allowed) || skip-- > 0)
+            continue;
+        CPU_ZERO(&pinned);
+        CPU_SET(cpu, &pinned);
+        return pthread_setaffinity_np(pthread_self(), sizeof(pinned), &pinned) == 0;
+    }
+    return false;
+#else
+    (void)index;
+    return false;
+#endif
+}
+
+#if defined(_WIN32)
+typedef SOCKET native_socket_t;
+#define close_native closesocket
+#else
+typedef int native_socket_t;
+#define close_native close
+#endif
+
+static bool set_nonblocking(native_socket_t fd)
+{
+#if defined(_WIN32)
+    u_long on = 1;
+    return ioctlsocket(fd, FIONBIO, &on) == 0;
+#else
+    const int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+// TCP addresses are PORT, :PORT or HOST:PORT, the first two on the loopback interface
+static bool split_tcp_address(const char *address, char *host, size_t host_size, unsigned long *port)
+{
+    const char *colon = strrchr(address, ':');
+    const char *digits = colon ? colon + 1 : address;
+    if (!digits[0] || strspn(digits, "0123456789") != strlen(digits))
+        return false;
+
+    const size_t host_length = colon ? (size_t)(colon - address) : 0;
+    if (host_length >= host_size)
+        return false;
+    memcpy(host, address, host_length);
+    host[host_length] = '\0';
+    *port = strtoul(digits, NULL, 10);
+    return true;
+}
+
+// Removes a Unix socket left at path, refusing anything that isn't a socket. TCP addresses are left alone
+bool platform_remove_socket(const char *address)
+{
+    char host[256];
+    unsigned long port;
+    if (split_tcp_address(address, host, sizeof(host), &port))
+        return true;
+#if defined(_WIN32)
+    return true;
+#else
+    struct stat st;
+    if (lstat(address, &st) != 0)
+        return errno == ENOENT;
+    if (!S_ISSOCK(st.st_mode))
+    {
+        fprintf(stderr, "%s exists and is not a socket, not replacing it\n", address);
+        return false;
+    }
+    return unlink(address) == 0;
+#endif
+}
+
+// PORT, :PORT or HOST:PORT is a TCP listener, anything else a Unix socket path
+platform_socket_t platform_listen(const char *address)
+{
+    char host[256];
+    unsigned long port = 0;
+    const bool tcp = split_tcp_address(address, host, sizeof(host), &port);
+    native_socket_t fd = (native_socket_t)-1;
+    bool bound = false;
+
+#if defined(_WIN32)
+    static bool started;
+    WSADATA wsa;
+    if (!started && WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+        return PLATFORM_NO_SOCKET;
+    started = true;
+    if (!tcp)
+    {
+        fprintf(stderr, "Unix sockets are not supported here, use PORT or HOST:PORT: %s\n", address);
+        return PLATFORM_NO_SOCKET;
+    }
+#endif
+
+    if (tcp)
+    {
+        if (port == 0 || port > 65535)
+        {
+            fprintf(stderr, "Invalid port %s\n", address);
+            return PLATFORM_NO_SOCKET;
+        }
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (host[0])
+        {
+            struct addrinfo hints, *found = NULL;
+            memset(&hints, 0, sizeof(hints));
+            hints.ai_family = AF_INET;
+            hints.ai_socktype = SOCK_STREAM;
+            if (getaddrinfo(host, NULL, &hints, &found) != 0 || !found)
+            {
+                fprintf(stderr, "Unknown host %s\n", host);
+                return PLATFORM_NO_SOCKET;
+            }
+            addr.sin_addr = ((struct sockaddr_in *)found->ai_addr)->sin_addr;
+            freeaddrinfo(found);
+        }
+
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        const int on = 1;
+        bound = fd != (native_socket_t)-1 &&
+                setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (const char *)&on, sizeof(on)) == 0 &&
+                bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    }
+#if !defined(_WIN32)
+    else
+    {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(address) >= sizeof(addr.sun_path))
+        {
+            fprintf(stderr, "Socket path too long %s\n", address);
+            return PLATFORM_NO_SOCKET;
+        }
+        strcpy(addr.sun_path, address);
+        if (!platform_remove_socket(address)) // Left over from an earlier run
+            return PLATFORM_NO_SOCKET;
+
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        bound = fd != -1 && bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    }
+#endif
+
+    if (bound && listen(fd, 1) == 0 && set_nonblocking(fd))
+        return (platform_socket_t)fd;
+
+    fprintf(stderr, "Could not listen on %s\n", address);
+    if (fd != (native_socket_t)-1)
+        close_native(fd);
+    return PLATFORM_NO_SOCKET;
+}
+
+// Pending connection if there is one, never waits
+platform_socket_t platform_accept(platform_socket_t listener)
+{
+    const native_socket_t fd = accept((native_socket_t)listener, NULL, NULL);
+    if (fd == (native_socket_t)-1)
+        return PLATFORM_NO_SOCKET;
+
+    // Packets are small and answered one at a time, no Nagle delay (fails harmlessly on Unix sockets)
+    const int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char *)&on, sizeof(on));
+    if (!set_nonblocking(fd))
+    {
+        close_native(fd);
+        return PLATFORM_NO_SOCKET;
+    }
+    return (platform_socket_t)fd;
+}
+
+// Bytes read, 0 if nothing arrived within timeout_ms, -1 once the peer is gone
+int platform_recv(platform_socket_t socket, void *data, size_t size, uint32_t timeout_ms)
+{
+    const native_socket_t fd = (native_socket_t)socket;
+#if defined(_WIN32)
+    WSAPOLLFD pfd = {.fd = fd, .events = POLLRDNORM};
+    const int ready = WSAPoll(&pfd, 1, (INT)timeout_ms);
+#else
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    const int ready = poll(&pfd, 1, (int)timeout_ms);
+#endif
+    if (ready == 0)
+        return 0;
+    if (ready < 0)
+        return -1;
+
+    const int n = (int)recv(fd, data, (int)size, 0);
+    if (n > 0)
+        return n;
+#if defined(_WIN32)
+    return n < 0 && WSAGetLastError() == WSAEWOULDBLOCK ? 0 : -1;
+#else
+    return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+#endif
+}
+
+// Whole buffer or false, waits for room since replies are small and the peer is local
+bool platform_send(platform_socket_t socket, const void *data, size_t size)
+{
+    const native_socket_t fd = (native_socket_t)socket;
+    const char *p = data;
+    while (size > 0)
+    {
+#if defined(_WIN32)
+        const int n = send(fd, p, (int)size, 0);
+        if (n < 0 && WSAGetLastError() == WSAEWOULDBLOCK)
+#else
+        const ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+#endif
+        {
+#if defined(_WIN32)
+            WSAPOLLFD pfd = {.fd = fd, .events = POLLWRNORM};
+            WSAPoll(&pfd, 1, 100);
+#else
+            struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+            poll(&pfd, 1, 100);
+#endif
+            continue;
+        }
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+void platform_close_socket(platform_socket_t socket)
+{
+    if (socket != PLATFORM_NO_SOCKET)
+        close_native((native_socket_t)socket);
+}
@@ -0,0 +1,48 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "type_defs.h"
+
+// Host helpers for the headless tools, no SDL needed
+
+// Monotonic time in nanoseconds
+uint64_t platform_now_ns(void);
+
+// Collect ROM files (*.ch8, *.sc8, *.xo8) under path, recursing into directories.
+// path may also be a single file. Appends to *paths/*count, sorted per directory.
+bool platform_find_roms(const char *path, char ***paths, size_t *count);
+void platform_free_roms(char **paths, size_t count);
+
+// Read whole file into a malloc'd buffer
+uint8_t *platform_read_file(const char *path, size_t *size);
+
+// Worker threads and the locks between them
+typedef void (*platform_thread_func_t)(void *arg);
+
+platform_thread_t *platform_thread_start(platform_thread_func_t func, void *arg);
+void platform_thread_join(platform_thread_t *thread);
+platform_mutex_t *platform_mutex_create(void);
+void platform_mutex_lock(platform_mutex_t *mutex);
+void platform_mutex_unlock(platform_mutex_t *mutex);
+void platform_mutex_destroy(platform_mutex_t *mutex);
+
+uint32_t platform_cpu_count(void);
+bool platform_pin_thread(uint32_t index);
+
+// Local stream sockets for the debug stub. address is PORT or :PORT on 127.0.0.1, HOST:PORT,
+// or a Unix socket path on POSIX. Sockets are non-blocking, PLATFORM_NO_SOCKET on failure
+typedef intptr_t platform_socket_t;
+#define PLATFORM_NO_SOCKET ((platform_socket_t)-1)
+
+platform_socket_t platform_listen(const char *address);
+platform_socket_t platform_accept(platform_socket_t listener);
+int platform_recv(platform_socket_t socket, void *data, size_t size, uint32_t timeout_ms);
+bool platform_send(platform_socket_t socket, const void *data, size_t size);
+void platform_close_socket(platform_socket_t socket);
+bool platform_remove_socket(const char *address);
+
+#endif
@@ -0,0 +1,303 @@
+// open/fstat/mmap are POSIX
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rom_index.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+static uint32_t rotl32(uint32_t value, uint32_t bits)
+{
+    return (value << bits) | (value >> (32 - bits));
+}
+
+static void sha1_block(uint32_t state[5], const uint8_t block[64])
+{
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++)
+        w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 |
+               (uint32_t)block[i * 4 + 2] << 8 | block[i * 4 + 3];
+    for (int i = 16; i < 80; i++)
+        w[i] = rotl32(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+    for (int i = 0; i < 80; i++)
+    {
+        uint32_t f, k;
+        if (i < 20)
+        {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        }
+        else if (i < 40)
+        {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        }
+        else if (i < 60)
+        {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        }
+        else
+        {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+
+        const uint32_t temp = rotl32(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rotl32(b, 30);
+        b = a;
+        a = temp;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+// SHA-1 of a rom image, same hashes the community CHIP-8 database uses
+void rom_sha1(const uint8_t *data, size_t size, uint8_t digest[ROM_SHA1_SIZE])
+{
+    uint32_t state[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    uint8_t block[64];
+    size_t i = 0;
+
+    for (; i + 64 <= size; i += 64)
+        sha1_block(state, &data[i]);
+
+    // Last partial block, 0x80 terminator and bit length, spilling into one more block if needed
+    const size_t tail = size - i;
+    memset(block, 0, sizeof(block));
+    memcpy(block, &data[i], tail);
+    block[tail] = 0x80;
+    if (tail >= 56)
+    {
+        sha1_block(state, block);
+        memset(block, 0, sizeof(block));
+    }
+    const uint64_t bits = (uint64_t)size * 8;
+    for (int b = 0; b < 8; b++)
+        block[63 - b] = (uint8_t)(bits >> (8 * b));
+    sha1_block(state, block);
+
+    for (int w = 0; w < 5; w++)
+        for (int b = 0; b < 4; b++)
+            digest[w * 4 + b] = (uint8_t)(state[w] >> (24 - 8 * b));
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint8_t *put_u16(uint8_t *p, uint16_t value)
+{
+    p[0] = value & 0xFF;
+    p[1] = value >> 8;
+    return p + 2;
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t value)
+{
+    for (int b = 0; b < 4; b++)
+        p[b] = (uint8_t)(value >> (8 * b));
+    return p + 4;
+}
+
+// Map index file read only and check its header
+bool rom_index_open(rom_index_t *index, const char *path)
+{
+    memset(index, 0, sizeof(rom_index_t));
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    HANDLE mapping = NULL;
+    if (GetFileSizeEx(file, &size) && size.QuadPart >= ROM_INDEX_HEADER_SIZE)
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file); // Mapping keeps the file open
+
+    if (!mapping)
+        return false;
+    index->data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!index->data)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+    index->mapping = mapping;
+    index->size = (size_t)size.QuadPart;
+#else
+    const int file = open(path, O_RDONLY);
+    if (file < 0)
+        return false;
+
+    struct stat info;
+    void *data = MAP_FAILED;
+    if (fstat(file, &info) == 0 && info.st_size >= ROM_INDEX_HEADER_SIZE)
+        data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, file, 0);
+    close(file); // Mapping keeps the file open
+
+    if (data == MAP_FAILED)
+        return false;
+    index->data = data;
+    index->size = (size_t)info.st_size;
+#endif
+
+    const uint8_t *header = index->data;
+    const uint32_t count = get_u32(&header[8]);
+    if (memcmp(header, ROM_INDEX_MAGIC, 4) != 0 ||
+        get_u16(&header[4]) != ROM_INDEX_VERSION ||
+        get_u16(&header[6]) != ROM_INDEX_RECORD_SIZE ||
+        (index->size - ROM_INDEX_HEADER_SIZE) / ROM_INDEX_RECORD_SIZE < count)
+    {
+        fprintf(stderr, "Rom index %s is not a version %d index !\n", path, ROM_INDEX_VERSION);
+        rom_index_close(index);
+        return false;
+    }
+    index->count = count;
+    return true;
+}
+
+void rom_index_close(rom_index_t *index)
+{
+    if (!index->data)
+        return;
+
+#if defined(_WIN32)
+    UnmapViewOfFile(index->data);
+    CloseHandle(index->mapping);
+#else
+    munmap((void *)index->data, index->size);
+#endif
+    memset(index, 0, sizeof(rom_index_t));
+}
+
+// Binary search the sorted records for sha1
+bool rom_index_find(const rom_index_t *index, const uint8_t sha1[ROM_SHA1_SIZE], rom_profile_t *profile)
+{
+    const uint8_t *records = index->data + ROM_INDEX_HEADER_SIZE;
+    uint32_t lo = 0, hi = index->count;
+
+    while (lo < hi)
+    {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        const uint8_t *record = &records[(size_t)mid * ROM_INDEX_RECORD_SIZE];
+        const int order = memcmp(record, sha1, ROM_SHA1_SIZE);
+
+        if (order < 0)
+            lo = mid + 1;
+        else if (order > 0)
+            hi = mid;
+        else
+        {
+            *profile = (rom_profile_t){
+                .extension = record[20] < NUM_EXTENSIONS ? (extension_t)record[20] : CHIP8,
+                .flags = record[21],
+                .insts_per_second = get_u32(&record[24]),
+                .foreground_color = get_u32(&record[28]),
+                .background_color = get_u32(&record[32]),
+            };
+            return true;
+        }
+    }
+    return false;
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+    return memcmp(((const rom_index_entry_t *)a)->sha1, ((const rom_index_entry_t *)b)->sha1, ROM_SHA1_SIZE);
+}
+
+// Sort entries by hash and write them out, duplicate roms keep the first entry
+bool rom_index_write(const char *path, rom_index_entry_t *entries, size_t count)
+{
+    uint8_t header[ROM_INDEX_HEADER_SIZE];
+    uint8_t record[ROM_INDEX_RECORD_SIZE];
+
+    qsort(entries, count, sizeof(rom_index_entry_t), compare_entries);
+
+    size_t unique = 0;
+    for (size_t i = 0; i < count; i++)
+        if (i == 0 || compare_entries(&entries[i - 1], &entries[i]) != 0)
+            entries[unique++] = entries[i];
+
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        fprintf(stderr, "Could not open rom index %s for writing !\n", path);
+        return false;
+    }
+
+    memcpy(header, ROM_INDEX_MAGIC, 4);
+    put_u32(put_u16(put_u16(&header[4], ROM_INDEX_VERSION), ROM_INDEX_RECORD_SIZE), (uint32_t)unique);
+    bool ok = fwrite(header, sizeof(header), 1, file) == 1;
+
+    for (size_t i = 0; ok && i < unique; i++)
+    {
+        const rom_profile_t *profile = &entries[i].profile;
+        uint8_t *p = record;
+        memcpy(p, entries[i].sha1, ROM_SHA1_SIZE);
+        p += ROM_SHA1_SIZE;
+        *p++ = (uint8_t)profile->extension;
+        *p++ = profile->flags;
+        p = put_u16(p, 0);
+        p = put_u32(p, profile->insts_per_second);
+        p = put_u32(p, profile->foreground_color);
+        put_u32(p, profile->background_color);
+        ok = fwrite(record, sizeof(record), 1, file) == 1;
+    }
+
+    ok = fclose(file) == 0 && ok;
+    if (!ok)
+        fprintf(stderr, "Could not write rom index %s !\n", path);
+    return ok;
+}
+
+// Hash rom file and look it up in the index file, false if either is missing or the rom is not indexed
+bool rom_index_lookup(const char *index_path, const char *rom_path, rom_profile_t *profile)
+{
+    uint8_t rom[4096];
+    uint8_t sha1[ROM_SHA1_SIZE];
+    rom_index_t index;
+
+    if (!index_path || !rom_index_open(&index, index_path))
+        return false;
+
+    FILE *file = fopen(rom_path, "rb");
+    if (!file)
+    {
+        rom_index_close(&index);
+        return false;
+    }
+    const size_t size = fread(rom, 1, sizeof(rom), file);
+    fclose(file);
+
+    rom_sha1(rom, size, sha1);
+    const bool found = rom_index_find(&index, sha1, profile);
+    rom_index_close(&index);
+    return found;
+}
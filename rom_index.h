@@ -0,0 +1,61 @@
+#ifndef ROM_INDEX_H
+#define ROM_INDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "type_defs.h"
+#include "app.h"
+
+#define ROM_SHA1_SIZE 20
+
+#define ROM_INDEX_MAGIC "C8IX"
+#define ROM_INDEX_VERSION 1
+#define ROM_INDEX_DEFAULT_PATH "chip8.idx"
+
+// File layout, little endian: header, then fixed size records sorted by SHA-1 so lookup is a
+// binary search straight in the mapped file
+// Header: magic, u16 version, u16 record size, u32 record count
+// Record: sha1[20], u8 extension, u8 flags, u16 reserved, u32 ips, u32 foreground, u32 background
+#define ROM_INDEX_HEADER_SIZE 12
+#define ROM_INDEX_RECORD_SIZE 36
+#define ROM_PROFILE_COLORS 0x01     // Record flag, colors override the defaults
+
+// How a rom wants to be run
+struct rom_profile
+{
+    extension_t extension;          // Quirks and extra opcodes
+    uint32_t insts_per_second;      // 0 keeps the default
+    uint8_t flags;                  // ROM_PROFILE_*
+    uint32_t foreground_color;      // RGBA8888, used with ROM_PROFILE_COLORS
+    uint32_t background_color;
+};
+
+// One indexed rom, what chip8-index collects before writing
+struct rom_index_entry
+{
+    uint8_t sha1[ROM_SHA1_SIZE];
+    rom_profile_t profile;
+};
+
+// Read only mapping of an index file
+struct rom_index
+{
+    const uint8_t *data;
+    size_t size;
+    uint32_t count;                 // Records
+    void *mapping;                  // Platform handle kept for unmapping
+};
+
+void rom_sha1(const uint8_t *data, size_t size, uint8_t digest[ROM_SHA1_SIZE]);
+
+bool rom_index_open(rom_index_t *index, const char *path);
+void rom_index_close(rom_index_t *index);
+bool rom_index_find(const rom_index_t *index, const uint8_t sha1[ROM_SHA1_SIZE], rom_profile_t *profile);
+bool rom_index_write(const char *path, rom_index_entry_t *entries, size_t count);
+
+// Hash rom file and look it up in the index file, false if either is missing or the rom is not indexed
+bool rom_index_lookup(const char *index_path, const char *rom_path, rom_profile_t *profile);
+
+#endif
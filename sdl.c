@@ -1,6 +1,49 @@
 #include "sdl.h"
 #include "app.h"
 #include "chip8.h"
+#include "state.h"
+#include "stats.h"
+#include "threads.h"
+
+// Build overlay with a background colored border around every cell x cell CHIP8 pixel
+static bool init_outlines(sdl_t *sdl, const config_t *config, uint32_t cell, SDL_Texture **texture)
+{
+    const uint32_t w = config->window_width * config->scale_factor;
+    const uint32_t h = config->window_height * config->scale_factor;
+    const uint32_t outline = config->background_color | 0xFF; // Always opaque, like the old RenderRect
+
+    // Too small to leave anything inside the border, no outlines at this resolution
+    if (cell < 3)
+        return true;
+
+    uint32_t *pixels = SDL_malloc(w * h * sizeof(uint32_t));
+    if (!pixels)
+        return false;
+
+    for (uint32_t y = 0; y < h; y++)
+    {
+        for (uint32_t x = 0; x < w; x++)
+        {
+            const bool edge = (x % cell == 0) || (x % cell == cell - 1) ||
+                              (y % cell == 0) || (y % cell == cell - 1);
+            pixels[y * w + x] = edge ? outline : 0x00000000; // Transparent inside
+        }
+    }
+
+    *texture = SDL_CreateTexture(sdl->renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STATIC, (int)w, (int)h);
+    if (!*texture)
+    {
+        SDL_Log("Could not create SDL outline texture %s\n", SDL_GetError());
+        SDL_free(pixels);
+        return false;
+    }
+
+    SDL_UpdateTexture(*texture, NULL, pixels, (int)(w * sizeof(uint32_t)));
+    SDL_SetTextureBlendMode(*texture, SDL_BLENDMODE_BLEND);
+    SDL_SetTextureScaleMode(*texture, SDL_SCALEMODE_NEAREST);
+    SDL_free(pixels);
+    return true;
+}
 
 bool init_sdl(sdl_t *sdl, config_t *config)
 {
@@ -29,6 +72,34 @@ bool init_sdl(sdl_t *sdl, config_t *config)
         return false;
     }
 
+    // Screen is uploaded as one texel per CHIP8 pixel and scaled up on the GPU, lores uses the top left
+    sdl->screen = SDL_CreateTexture(sdl->renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING,
+                                    DISPLAY_WIDTH, DISPLAY_HEIGHT);
+    if (!sdl->screen)
+    {
+        SDL_Log("Could not create SDL screen texture %s\n", SDL_GetError());
+        return false;
+    }
+    SDL_SetTextureScaleMode(sdl->screen, SDL_SCALEMODE_NEAREST);
+    SDL_SetTextureBlendMode(sdl->screen, SDL_BLENDMODE_NONE);
+
+    // Window is sized for lores, hires pixels are half as big
+    if (config->pixel_outlines &&
+        (!init_outlines(sdl, config, config->scale_factor, &sdl->outlines[0]) ||
+         !init_outlines(sdl, config, config->scale_factor * LORES_WIDTH / DISPLAY_WIDTH, &sdl->outlines[1])))
+        return false;
+
+    // Presents paced by the display, only the render thread ever waits on it
+    SDL_SetRenderVSync(sdl->renderer, 1);
+
+    // Pushed by the emulation thread to wake the render thread for a new frame
+    sdl->frame_event = SDL_RegisterEvents(1);
+
+    // Direct keycode lookup, no KEYMAP scan per key event
+    SDL_memset(sdl->keypad_lookup, 0xFF, sizeof(sdl->keypad_lookup));
+    for (uint32_t i = 0; i < NUM_KEYS; i++)
+        sdl->keypad_lookup[KEYMAP[i][0] % KEYPAD_LOOKUP_SIZE] = KEYMAP[i][1];
+
     SDL_memset(&sdl->want, 0, sizeof(sdl->want)); /* or SDL_zero(want) */
     // Init audio stuff
     sdl->want = (SDL_AudioSpec) {
@@ -52,6 +123,17 @@ bool init_sdl(sdl_t *sdl, config_t *config)
         return false;
     }
 
+    // Everything the hot loop generates fits here, no per frame allocation
+    sdl->audio_samples = config->audio_sample_rate * AUDIO_LATENCY_MS / 1000;
+    sdl->audio_buffer = SDL_malloc(sdl->audio_samples * sizeof(int16_t));
+    if (!sdl->audio_buffer) {
+        SDL_Log("Could not allocate audio buffer\n");
+        return false;
+    }
+
+    // Stream plays for good, silence is gated in the samples
+    SDL_ResumeAudioStreamDevice(sdl->stream);
+
     return true;
 }
 
@@ -67,98 +149,332 @@ void clear_screen(const sdl_t sdl, const config_t *config)
     SDL_RenderClear(sdl.renderer);
 }
 
-// Update window
-void update_screen(const sdl_t sdl, const config_t *config, chip8_t *chip8) {
-    SDL_FRect rect = {
-        .x = 0,
-        .y = 0,
-        .w = (float)config->scale_factor,
-        .h = (float)config->scale_factor,
-    };
+// Draw the newest frame from the emulation thread. A static screen isn't redrawn or presented
+// until the window needs it, and the texture is only uploaded when its pixels changed
+void update_screen(sdl_t *sdl, const config_t *config, const render_frame_t *frame) {
+    const uint32_t width = frame->hires ? DISPLAY_WIDTH : LORES_WIDTH;
+    const uint32_t height = frame->hires ? DISPLAY_HEIGHT : LORES_HEIGHT;
 
-    // Grap background color values to draw outlines
-    const uint8_t bg_r = (config->background_color >> 24) & 0xFF;
-    const uint8_t bg_g = (config->background_color >> 16) & 0xFF;
-    const uint8_t bg_b = (config->background_color >> 8) & 0xFF;
-    const uint8_t bg_a = (config->background_color >> 0) & 0xFF;
-
-    // Loop through display pixels, draw a rectangle per pixel to the SDL window
-    for(uint32_t i = 0; i < sizeof(chip8->display); i++) {
-        // Translate 1D index i value to 2D X/Y coordinates
-        // X = i % window width
-        // Y = i / window width
-        rect.x = (float)((i % config->window_width) * config->scale_factor);
-        rect.y = (float)((i / config->window_width) * config->scale_factor);
-
-        if(chip8->display[i]) {
-            // If pixel is on, draw foreground color
-            if (chip8->pixel_color[i] != config->foreground_color) {
-                // Lerp towards foreground color
-                chip8->pixel_color[i] = color_lerp(chip8->pixel_color[i], 
-                                                   config->foreground_color, 
-                                                   config->color_lerp_rate); 
-            }
+    if (frame->version == sdl->screen_version && frame->hires == sdl->screen_hires && !sdl->needs_redraw)
+        return;
+    sdl->screen_hires = frame->hires;
+    sdl->needs_redraw = false;
+
+    // Frames in between may have been skipped, so upload the whole active area in one go
+    if (frame->version != sdl->screen_version)
+    {
+        const SDL_Rect area = {.x = 0, .y = 0, .w = (int)width, .h = (int)height};
+        SDL_UpdateTexture(sdl->screen, &area, frame->pixel_color, (int)(DISPLAY_WIDTH * sizeof(uint32_t)));
+        sdl->screen_version = frame->version;
+    }
+
+    // One scaled copy of the active resolution for the screen, one for the outlines
+    const SDL_FRect active = {.x = 0, .y = 0, .w = (float)width, .h = (float)height};
+    SDL_Texture *outlines = sdl->outlines[frame->hires];
+    SDL_RenderTexture(sdl->renderer, sdl->screen, &active, NULL);
+    if (config->pixel_outlines && outlines)
+        SDL_RenderTexture(sdl->renderer, outlines, NULL, NULL);
 
-            const uint8_t r = (chip8->pixel_color[i] >> 24) & 0xFF;
-            const uint8_t g = (chip8->pixel_color[i] >> 16) & 0xFF;
-            const uint8_t b = (chip8->pixel_color[i] >> 8) & 0xFF;
-            const uint8_t a = (chip8->pixel_color[i] >> 0) & 0xFF;
+    SDL_RenderPresent(sdl->renderer);
+}
+
+void final_cleanup(const sdl_t sdl)
+{
+    for (uint32_t i = 0; i < 2; i++)
+        if (sdl.outlines[i])
+            SDL_DestroyTexture(sdl.outlines[i]);
+    SDL_DestroyTexture(sdl.screen);
+    SDL_DestroyRenderer(sdl.renderer);
+    SDL_DestroyWindow(sdl.window);
+    SDL_DestroyAudioStream(sdl.stream);
+    SDL_free(sdl.audio_buffer);
+    SDL_Quit();
+}
+
+// Render thread: turn SDL events into commands for the emulation thread, false once quitting.
+// Keypad events keep their SDL timestamp so the emulation thread can place them inside a frame
+bool handle_input(sdl_t *sdl, command_queue_t *commands)
+{
+    SDL_Event event;
 
-            SDL_SetRenderDrawColor(sdl.renderer, r, g, b, a);
-            SDL_RenderFillRect(sdl.renderer, &rect);
+    while (SDL_PollEvent(&event))
+    {
+        switch (event.type)
+        {
+        case SDL_EVENT_QUIT:
+            return false; // Will exit main emulator loop
 
-            // TODO: Move this outside if/else
-            // if user requested drawing pixel outlines
-            if(config->pixel_outlines) {
-                SDL_SetRenderDrawColor(sdl.renderer, bg_r, bg_g, bg_b, bg_a);
-                SDL_RenderRect(sdl.renderer, &rect);
+        case SDL_EVENT_KEY_DOWN:
+            switch (event.key.key)
+            {
+            case SDLK_ESCAPE:
+                return false; // Exit window
+            case SDLK_SPACE:
+                command_push(commands, CMD_PAUSE, 0); // Pause / Resume
+                break;
+            case SDLK_ASTERISK:
+                // '*': Reset CHIP8 machine for current rom
+                command_push(commands, CMD_RESET, 0);
+                break;
+            case SDLK_BACKSPACE:
+                // Backspace: Rewind while held
+                command_push(commands, CMD_REWIND_START, 0);
+                break;
+            case SDLK_F5:
+                // F5/F9: Save/Load state next to the rom
+                command_push(commands, CMD_SAVE_STATE, 0);
+                break;
+            case SDLK_F9:
+                command_push(commands, CMD_LOAD_STATE, 0);
+                break;
+#ifdef CHIP8_STATS
+            case SDLK_F3:
+                // F3: Dump execution counters next to the rom
+                command_push(commands, CMD_WRITE_STATS, 0);
+                break;
+#endif
+            case SDLK_TAB:
+                // Tab: Toggle turbo
+                command_push(commands, CMD_TURBO, 0);
+                break;
+            case SDLK_J:
+                // 'J': Decrease color lerp rate
+                command_push(commands, CMD_LERP_RATE, -1);
+                break;
+            case SDLK_K:
+                // 'K': Increase color lerp rate
+                command_push(commands, CMD_LERP_RATE, 1);
+                break;
+            case SDLK_O:
+                // 'O': Decrease volume
+                command_push(commands, CMD_VOLUME, -1);
+                break;
+            case SDLK_P:
+                // 'P': Increase volume
+                command_push(commands, CMD_VOLUME, 1);
+                break;
+            default:
+                break;
             }
+            // Repeats while held change nothing on the keypad
+            if (event.key.key < KEYPAD_LOOKUP_SIZE && sdl->keypad_lookup[event.key.key] != 0xFF && !event.key.repeat)
+                command_push_at(commands, CMD_KEY_DOWN, sdl->keypad_lookup[event.key.key], event.key.timestamp);
+            break;
+
+        case SDL_EVENT_KEY_UP:
+            if (event.key.key == SDLK_BACKSPACE)
+                command_push(commands, CMD_REWIND_STOP, 0); // Stop rewinding
+            if (event.key.key < KEYPAD_LOOKUP_SIZE && sdl->keypad_lookup[event.key.key] != 0xFF)
+                command_push_at(commands, CMD_KEY_UP, sdl->keypad_lookup[event.key.key], event.key.timestamp);
+            break;
+
+        case SDL_EVENT_WINDOW_EXPOSED:
+        case SDL_EVENT_WINDOW_RESIZED:
+        case SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED:
+            sdl->needs_redraw = true; // Window contents lost, frame or not
+            break;
+        default:
+            break;
+        }
+    }
+    return true;
+}
+
+// Emulation thread: apply everything the render thread queued since the last call.
+// Key events are collected into keys instead when given, for the frame slice to place by timestamp
+void handle_commands(chip8_t *chip8, config_t *config, command_queue_t *commands, command_t *keys, uint32_t *num_keys)
+{
+    command_t command;
 
-        } else {
-            // If not draw background color
-            if (chip8->pixel_color[i] != config->foreground_color) {
-                // Lerp towards background color
-                chip8->pixel_color[i] = color_lerp(chip8->pixel_color[i], 
-                                                   config->background_color, 
-                                                   config->color_lerp_rate); 
+    while (chip8->state != QUIT && command_pop(commands, &command))
+    {
+        switch (command.type)
+        {
+        case CMD_QUIT:
+            chip8->state = QUIT; // Will exit emulation loop
+            break;
+        case CMD_KEY_DOWN:
+        case CMD_KEY_UP:
+            if (keys && *num_keys < COMMAND_QUEUE_SIZE)
+                keys[(*num_keys)++] = command;
+            else
+                chip8_set_key(chip8, (uint8_t)command.value, command.type == CMD_KEY_DOWN);
+            break;
+        case CMD_PAUSE:
+            if (chip8->state == RUNNING)
+            {
+                chip8->state = PAUSED; // Pause
+                puts("======= PAUSED =======");
             }
+            else
+                chip8->state = RUNNING; // Resume
+            break;
+        case CMD_RESET:
+            init_chip8(chip8, config, chip8->rom_name);
+            break;
+        case CMD_REWIND_START:
+            if (chip8->state == RUNNING)
+                chip8->state = REWINDING;
+            break;
+        case CMD_REWIND_STOP:
+            if (chip8->state == REWINDING)
+                chip8->state = RUNNING;
+            break;
+        case CMD_SAVE_STATE:
+        case CMD_LOAD_STATE: {
+            char state_path[1024];
+            snprintf(state_path, sizeof(state_path), "%s.state", chip8->rom_name);
+            if (command.type == CMD_SAVE_STATE ? chip8_save_state_file(chip8, state_path)
+                                               : chip8_load_state_file(chip8, state_path))
+                printf("%s %s\n", command.type == CMD_SAVE_STATE ? "Saved" : "Loaded", state_path);
+            break;
+        }
+#ifdef CHIP8_STATS
+        case CMD_WRITE_STATS: {
+            char stats_path[1024];
+            snprintf(stats_path, sizeof(stats_path), "%s.stats.json", chip8->rom_name);
+            if (chip8->stats && chip8_stats_write_json(chip8->stats, stats_path))
+                printf("Wrote %s\n", stats_path);
+            break;
+        }
+#endif
+        case CMD_TURBO:
+            config->turbo = !config->turbo;
+            puts(config->turbo ? "======= TURBO =======" : "======= NORMAL SPEED =======");
+            break;
+        case CMD_LERP_RATE:
+            if (command.value < 0 && config->color_lerp_rate > 0.1)
+                config->color_lerp_rate -= 0.1f;
+            else if (command.value > 0 && config->color_lerp_rate < 0.9)
+                config->color_lerp_rate += 0.1f;
+            break;
+        case CMD_VOLUME:
+            if (command.value < 0 && config->volume > 0)
+                config->volume -= 500;
+            else if (command.value > 0 && config->volume < INT16_MAX)
+                config->volume += 500;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+// Top the audio stream up to AUDIO_LATENCY_MS, tone gated per sample by the sound timer
+void handle_audio(sdl_t *sdl, chip8_t *chip8, const config_t *config)
+{
+    // Tone owed is the timer's remaining duration in samples. Anything but a 60hz tick
+    // (FX18, a state load) restarts the count, so it ends on the sample the timer runs out
+    if (chip8->sound_timer > chip8->audio_timer || chip8->sound_timer + 1 < chip8->audio_timer)
+        chip8->audio_tone_left = chip8->sound_timer * config->audio_sample_rate / FRAMES_PER_SECOND;
+    chip8->audio_timer = chip8->sound_timer;
+    if (config->turbo)
+        chip8->audio_tone_left = 0; // Turbo is muted
+
+    const int queued = SDL_GetAudioStreamQueued(sdl->stream) / (int)sizeof(int16_t);
+    if (queued < 0 || (uint32_t)queued >= sdl->audio_samples)
+        return;
 
-            const uint8_t r = (chip8->pixel_color[i] >> 24) & 0xFF;
-            const uint8_t g = (chip8->pixel_color[i] >> 16) & 0xFF;
-            const uint8_t b = (chip8->pixel_color[i] >> 8) & 0xFF;
-            const uint8_t a = (chip8->pixel_color[i] >> 0) & 0xFF;
+    const uint32_t num_samples = sdl->audio_samples - (uint32_t)queued;
+    const uint32_t half_square_wave_period = config->audio_sample_rate / config->square_wave_freq / 2;
+    const bool running = chip8->state == RUNNING;
 
-            SDL_SetRenderDrawColor(sdl.renderer, r, g, b, a);
-            SDL_RenderFillRect(sdl.renderer, &rect);
+    for (uint32_t i = 0; i < num_samples; i++) {
+        if (!running || chip8->audio_tone_left == 0) {
+            sdl->audio_buffer[i] = 0;
+            continue;
         }
+        chip8->audio_tone_left--;
+        sdl->audio_buffer[i] = ((chip8->audio_phase++ / half_square_wave_period) % 2)
+                                   ?  config->volume
+                                   : -config->volume;
     }
 
-    SDL_RenderPresent(sdl.renderer);
+    // Push the generated samples into the SDL_AudioStream
+    SDL_PutAudioStreamData(sdl->stream, sdl->audio_buffer, (int)(num_samples * sizeof(int16_t)));
 }
 
-void final_cleanup(const sdl_t sdl)
+// Tick CHIP8 timers at 60hz, handle_audio turns the remaining sound_timer into tone samples
+void update_timers(chip8_t *chip8) {
+    chip8_tick_timers(chip8);
+}
+
+void init_frame_clock(frame_clock_t *frame_clock)
 {
-    SDL_DestroyRenderer(sdl.renderer);
-    SDL_DestroyWindow(sdl.window);
-    SDL_DestroyAudioStream(sdl.stream);
-    SDL_Quit();
+    *frame_clock = (frame_clock_t){.start_ns = SDL_GetTicksNS()};
+}
+
+// Instructions to run this frame, fractions carry over so 700 ips is 700 and not 11 * 60
+uint32_t frame_clock_insts(frame_clock_t *frame_clock, uint32_t insts_per_second)
+{
+    const uint64_t total = (uint64_t)insts_per_second + frame_clock->inst_remainder;
+    frame_clock->inst_remainder = (uint32_t)(total % FRAMES_PER_SECOND);
+    return (uint32_t)(total / FRAMES_PER_SECOND);
 }
 
-uint32_t color_lerp(const uint32_t start_color, const uint32_t end_color, const float t) {
-    const uint8_t s_r = (uint8_t)((start_color >> 24) & 0xFF);
-    const uint8_t s_g = (uint8_t)((start_color >> 16) & 0xFF);
-    const uint8_t s_b = (uint8_t)((start_color >> 8) & 0xFF);
-    const uint8_t s_a = (uint8_t)((start_color >> 0) & 0xFF);
+// Sleep until the next frame deadline, spinning the last FRAME_SPIN_NS for precision.
+// Returns 0 on time, 1 for a late frame plus any whole frames dropped by a resync
+uint32_t wait_frame_clock(frame_clock_t *frame_clock)
+{
+    frame_clock->frame++;
+    const uint64_t deadline = frame_clock->start_ns + frame_clock->frame * SDL_NS_PER_SECOND / FRAMES_PER_SECOND;
+    uint64_t now = SDL_GetTicksNS();
+
+    // Too far behind (debugger, window drag, suspend), start over instead of fast forwarding
+    if (now > deadline + 4 * SDL_NS_PER_SECOND / FRAMES_PER_SECOND)
+    {
+        frame_clock->start_ns = now;
+        frame_clock->frame = 0;
+        return 1 + (uint32_t)((now - deadline) * FRAMES_PER_SECOND / SDL_NS_PER_SECOND);
+    }
+    if (now > deadline)
+        return 1; // Late, later deadlines catch up
 
-    const uint8_t e_r = (uint8_t)((end_color >> 24) & 0xFF);
-    const uint8_t e_g = (uint8_t)((end_color >> 16) & 0xFF);
-    const uint8_t e_b = (uint8_t)((end_color >> 8) & 0xFF);
-    const uint8_t e_a = (uint8_t)((end_color >> 0) & 0xFF);
+    if (deadline > now + FRAME_SPIN_NS)
+        SDL_DelayNS(deadline - now - FRAME_SPIN_NS);
 
-    const uint8_t ret_r = (uint8_t)(((1-t) * s_r) + (t * e_r));
-    const uint8_t ret_g = (uint8_t)(((1-t) * s_g) + (t * e_g));
-    const uint8_t ret_b = (uint8_t)(((1-t) * s_b) + (t * e_b));
-    const uint8_t ret_a = (uint8_t)(((1-t) * s_a) + (t * e_a));
+    while ((now = SDL_GetTicksNS()) < deadline)
+        SDL_CPUPauseInstruction();
+    return 0;
+}
 
-    return (ret_r << 24) | (ret_g << 16) | (ret_b << 8) | ret_a;
-}
\ No newline at end of file
+// Time left before the next frame deadline, 0 if already past it
+uint64_t frame_clock_remaining_ns(const frame_clock_t *frame_clock)
+{
+    const uint64_t deadline = frame_clock->start_ns + (frame_clock->frame + 1) * SDL_NS_PER_SECOND / FRAMES_PER_SECOND;
+    const uint64_t now = SDL_GetTicksNS();
+    return deadline > now ? deadline - now : 0;
+}
+
+// Sleep until the given slice of the current frame is due, no spinning since slices only place input
+void wait_frame_slice(const frame_clock_t *frame_clock, uint32_t slice)
+{
+    const uint64_t due = frame_clock->start_ns + (frame_clock->frame * FRAME_SLICES + slice) * SDL_NS_PER_SECOND /
+                                                 (FRAMES_PER_SECOND * FRAME_SLICES);
+    const uint64_t now = SDL_GetTicksNS();
+    if (due > now)
+        SDL_DelayNS(due - now);
+}
+
+// Block on the command queue until close to the next frame deadline, true when a command arrived
+bool wait_frame_command(const frame_clock_t *frame_clock, command_queue_t *commands)
+{
+    const uint64_t remaining = frame_clock_remaining_ns(frame_clock);
+    if (remaining <= FRAME_SPIN_NS + SDL_NS_PER_MS)
+        return false;
+
+    return SDL_WaitSemaphoreTimeout(commands->wake, (Sint32)((remaining - FRAME_SPIN_NS) / SDL_NS_PER_MS));
+}
+
+// Show emulation speed in the title while in turbo
+void update_title(const sdl_t *sdl, const config_t *config, const render_frame_t *frame)
+{
+    char title[128];
+    if (frame->turbo)
+        snprintf(title, sizeof(title), "Chip-8 Emulator - Turbo %.2f Minst/s (%.1fx)",
+                 frame->insts_per_second / 1e6,
+                 frame->insts_per_second / (config->insts_per_second ? config->insts_per_second : 1));
+    else
+        snprintf(title, sizeof(title), "Chip-8 Emulator");
+    SDL_SetWindowTitle(sdl->window, title);
+}
@@ -4,6 +4,29 @@
 #include <SDL3/SDL.h>
 
 #include "type_defs.h"
+#include "chip8.h"
+
+    // QWERTY           // CHIP8-KeyMap
+const static uint8_t KEYMAP[NUM_KEYS][2] = {
+    {SDLK_1, 0x1},      // 1 
+    {SDLK_2, 0x2},      // 2
+    {SDLK_3, 0x3},      // 3
+    {SDLK_4, 0xC},      // C
+    {SDLK_Q, 0x4},      // 4
+    {SDLK_W, 0x5},      // 5
+    {SDLK_E, 0x6},      // 6
+    {SDLK_R, 0xD},      // D
+    {SDLK_A, 0x7},      // 7
+    {SDLK_S, 0x8},      // 8
+    {SDLK_D, 0x9},      // 9
+    {SDLK_F, 0xE},      // E
+    {SDLK_Z, 0xA},      // A
+    {SDLK_X, 0x0},      // 0
+    {SDLK_C, 0xB},      // B
+    {SDLK_V, 0xF}       // F
+};
+
+#define KEYPAD_LOOKUP_SIZE 128         // Keycodes in KEYMAP are ASCII, one lookup entry each
 
 struct sdl
 {
@@ -11,13 +34,45 @@ struct sdl
     SDL_Renderer *renderer;
     SDL_AudioSpec want;
     SDL_AudioStream *stream;
+    SDL_Texture *screen;        // Streaming texture, one texel per CHIP8 pixel, hires sized
+    SDL_Texture *outlines[2];   // Precomputed pixel outline overlays at window resolution, lores and hires grid
+    int16_t *audio_buffer;      // Preallocated, AUDIO_LATENCY_MS of samples, emulation thread only
+    uint32_t audio_samples;     // Samples audio_buffer holds
+    uint64_t screen_version;    // Frame version the screen texture holds
+    bool screen_hires;          // Resolution last presented
+    bool needs_redraw;          // Window exposed or resized, present even if the frame didn't change
+    Uint32 frame_event;         // User event type the emulation thread pushes per published frame
+    uint8_t keypad_lookup[KEYPAD_LOOKUP_SIZE];  // Keycode to CHIP8 key, 0xFF if unmapped
+};
+
+#define AUDIO_LATENCY_MS 30                   // Audio kept queued ahead of the device
+
+#define FRAMES_PER_SECOND 60
+#define FRAME_SPIN_NS (2 * SDL_NS_PER_MS)     // Busy wait the last part of a frame, sleeps overshoot
+#define FRAME_SLICES 4                        // Instruction batch spread over the frame, key events land within ~4ms
+
+// Absolute frame deadlines, frame n is due at start_ns + n * 1s / 60 so rounding never accumulates
+struct frame_clock
+{
+    uint64_t start_ns;          // SDL_GetTicksNS() of frame 0
+    uint64_t frame;             // Frames scheduled since start_ns
+    uint32_t inst_remainder;    // Instructions carried over to the next frame, in 1/60ths
 };
 
 bool init_sdl(sdl_t *sdl, config_t *config);
 void clear_screen(const sdl_t sdl, const config_t *config);
-void update_screen(const sdl_t sdl, const config_t *config, chip8_t *chip8);
+void update_screen(sdl_t *sdl, const config_t *config, const render_frame_t *frame);
 void final_cleanup(const sdl_t sdl);
+bool handle_input(sdl_t *sdl, command_queue_t *commands);
+void handle_commands(chip8_t *chip8, config_t *config, command_queue_t *commands, command_t *keys, uint32_t *num_keys);
+void handle_audio(sdl_t *sdl, chip8_t *chip8, const config_t *config);
+void update_timers(chip8_t *chip8);
+void init_frame_clock(frame_clock_t *frame_clock);
+uint32_t frame_clock_insts(frame_clock_t *frame_clock, uint32_t insts_per_second);
+uint32_t wait_frame_clock(frame_clock_t *frame_clock);
+uint64_t frame_clock_remaining_ns(const frame_clock_t *frame_clock);
+void wait_frame_slice(const frame_clock_t *frame_clock, uint32_t slice);
+bool wait_frame_command(const frame_clock_t *frame_clock, command_queue_t *commands);
+void update_title(const sdl_t *sdl, const config_t *config, const render_frame_t *frame);
 
-// Helper functions
-uint32_t color_lerp(const uint32_t start_color, const uint32_t end_color, const float t);
 #endif
\ No newline at end of file
@@ -0,0 +1,346 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "state.h"
+
+// Little endian field writers/readers so state files move between hosts
+static uint8_t *put_u16(uint8_t *p, uint16_t value)
+{
+    p[0] = value & 0xFF;
+    p[1] = value >> 8;
+    return p + 2;
+}
+
+static const uint8_t *get_u16(const uint8_t *p, uint16_t *value)
+{
+    *value = (uint16_t)(p[0] | (p[1] << 8));
+    return p + 2;
+}
+
+static uint8_t *put_bytes(uint8_t *p, const void *data, size_t size)
+{
+    memcpy(p, data, size);
+    return p + size;
+}
+
+static const uint8_t *get_bytes(const uint8_t *p, void *data, size_t size)
+{
+    memcpy(data, p, size);
+    return p + size;
+}
+
+size_t chip8_save_state(const chip8_t *chip8, uint8_t *buffer, size_t size)
+{
+    if (size < STATE_SIZE)
+        return 0;
+
+    uint8_t *p = buffer;
+    p = put_bytes(p, STATE_MAGIC, 4);
+    p = put_u16(p, STATE_VERSION);
+    p = put_bytes(p, chip8->ram, sizeof(chip8->ram));
+    p = put_bytes(p, chip8->V, sizeof(chip8->V));
+    p = put_u16(p, chip8->I);
+    p = put_u16(p, chip8->PC);
+    for (int i = 0; i < 12; i++)
+        p = put_u16(p, chip8->stack[i]);
+    *p++ = (uint8_t)(chip8->stack_ptr - chip8->stack); // Pointer saved as index
+    *p++ = chip8->delay_timer;
+    *p++ = chip8->sound_timer;
+    for (int i = 0; i < NUM_KEYS; i++)
+        *p++ = chip8->keypad[i];
+    *p++ = chip8->wait_key;
+    for (int b = 0; b < 8; b++)
+        *p++ = (uint8_t)(chip8->rng >> (8 * b));
+    *p++ = chip8->hires;
+    *p++ = chip8->planes;
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++)
+    {
+        for (int y = 0; y < DISPLAY_HEIGHT; y++)
+        {
+            for (int w = 0; w < DISPLAY_ROW_WORDS; w++)
+            {
+                const uint64_t row = chip8->display[plane][y][w];
+                for (int b = 0; b < 8; b++)
+                    *p++ = (uint8_t)(row >> (8 * b));
+            }
+        }
+    }
+
+    return (size_t)(p - buffer);
+}
+
+bool chip8_load_state(chip8_t *chip8, const uint8_t *buffer, size_t size)
+{
+    uint16_t version;
+    uint8_t stack_index;
+
+    if (size < STATE_SIZE || memcmp(buffer, STATE_MAGIC, 4) != 0)
+        return false;
+
+    const uint8_t *p = get_u16(buffer + 4, &version);
+    if (version != STATE_VERSION)
+        return false;
+
+    p = get_bytes(p, chip8->ram, sizeof(chip8->ram));
+    p = get_bytes(p, chip8->V, sizeof(chip8->V));
+    p = get_u16(p, &chip8->I);
+    p = get_u16(p, &chip8->PC);
+    for (int i = 0; i < 12; i++)
+        p = get_u16(p, &chip8->stack[i]);
+    stack_index = *p++;
+    chip8->stack_ptr = &chip8->stack[stack_index < 12 ? stack_index : 12];
+    chip8->delay_timer = *p++;
+    chip8->sound_timer = *p++;
+    for (int i = 0; i < NUM_KEYS; i++)
+        chip8->keypad[i] = *p++ != 0;
+    const uint8_t wait_key = *p++;
+    chip8->wait_key = wait_key < NUM_KEYS ? wait_key : 0xFF;
+    chip8->rng = 0;
+    for (int b = 0; b < 8; b++)
+        chip8->rng |= (uint64_t)*p++ << (8 * b);
+    chip8->hires = *p++ != 0;
+    chip8->planes = *p++ & ((1u << DISPLAY_PLANES) - 1);
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++)
+    {
+        for (int y = 0; y < DISPLAY_HEIGHT; y++)
+        {
+            for (int w = 0; w < DISPLAY_ROW_WORDS; w++)
+            {
+                uint64_t row = 0;
+                for (int b = 0; b < 8; b++)
+                    row |= (uint64_t)*p++ << (8 * b);
+                chip8->display[plane][y][w] = row;
+            }
+        }
+    }
+
+    // Ram changed under the caches, redraw everything
+    memset(chip8->icache, 0, sizeof(chip8->icache));
+    chip8->written_lo = 0;
+    chip8->written_hi = sizeof(chip8->ram);
+    chip8->dirty_rows = ~0ull;
+    chip8->draw = true;
+
+    return true;
+}
+
+bool chip8_save_state_file(const chip8_t *chip8, const char *path)
+{
+    uint8_t buffer[STATE_SIZE];
+    const size_t size = chip8_save_state(chip8, buffer, sizeof(buffer));
+
+    FILE *file = fopen(path, "wb");
+    if (!file)
+    {
+        fprintf(stderr, "Could not open state file %s for writing !\n", path);
+        return false;
+    }
+
+    const bool ok = fwrite(buffer, size, 1, file) == 1;
+    fclose(file);
+    return ok;
+}
+
+bool chip8_load_state_file(chip8_t *chip8, const char *path)
+{
+    uint8_t buffer[STATE_SIZE];
+
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        fprintf(stderr, "State file %s is invalid or does not exist !\n", path);
+        return false;
+    }
+
+    const bool ok = fread(buffer, sizeof(buffer), 1, file) == 1;
+    fclose(file);
+
+    if (!ok || !chip8_load_state(chip8, buffer, sizeof(buffer)))
+    {
+        fprintf(stderr, "State file %s is not a version %d CHIP8 state !\n", path, STATE_VERSION);
+        return false;
+    }
+    return true;
+}
+
+static uint8_t *put_varint(uint8_t *p, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        *p++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (uint8_t)value;
+    return p;
+}
+
+static const uint8_t *get_varint(const uint8_t *p, uint32_t *value)
+{
+    uint32_t shift = 0;
+    *value = 0;
+    do
+    {
+        *value |= (uint32_t)(*p & 0x7F) << shift;
+        shift += 7;
+    } while (*p++ & 0x80);
+    return p;
+}
+
+// XOR state against base (zeros if NULL) and store as (zero run, literal run) pairs
+static uint32_t pack_delta(const uint8_t *state, const uint8_t *base, uint8_t *out)
+{
+    uint8_t *p = out;
+    uint32_t i = 0;
+
+    while (i < STATE_SIZE)
+    {
+        uint32_t zeros = 0;
+        while (i + zeros < STATE_SIZE && state[i + zeros] == (base ? base[i + zeros] : 0))
+            zeros++;
+        i += zeros;
+
+        uint32_t literals = 0;
+        while (i + literals < STATE_SIZE && state[i + literals] != (base ? base[i + literals] : 0))
+            literals++;
+
+        p = put_varint(p, zeros);
+        p = put_varint(p, literals);
+        for (uint32_t j = 0; j < literals; j++)
+            *p++ = state[i + j] ^ (base ? base[i + j] : 0);
+        i += literals;
+    }
+
+    return (uint32_t)(p - out);
+}
+
+// XOR packed delta into state
+static void unpack_delta(const uint8_t *in, uint32_t length, uint8_t *state)
+{
+    const uint8_t *end = in + length;
+    uint32_t i = 0;
+
+    while (in < end)
+    {
+        uint32_t zeros, literals;
+        in = get_varint(in, &zeros);
+        in = get_varint(in, &literals);
+        i += zeros;
+        for (uint32_t j = 0; j < literals && i < STATE_SIZE; j++)
+            state[i++] ^= *in++;
+    }
+}
+
+bool init_rewind(rewind_t *rewind)
+{
+    memset(rewind, 0, sizeof(rewind_t));
+    rewind->buffer = malloc(REWIND_BUFFER_SIZE);
+    rewind->frames = malloc(REWIND_MAX_FRAMES * sizeof(rewind_frame_t));
+
+    if (!rewind->buffer || !rewind->frames)
+    {
+        fprintf(stderr, "Could not allocate rewind buffer !\n");
+        destroy_rewind(rewind);
+        return false;
+    }
+    return true;
+}
+
+void destroy_rewind(rewind_t *rewind)
+{
+    free(rewind->buffer);
+    free(rewind->frames);
+    rewind->buffer = NULL;
+    rewind->frames = NULL;
+}
+
+// Drop oldest frame plus any deltas left without their keyframe
+static void drop_oldest(rewind_t *rewind)
+{
+    rewind->first++;
+    while (rewind->first < rewind->next && rewind->frames[rewind->first % REWIND_MAX_FRAMES].keyframe < rewind->first)
+        rewind->first++;
+}
+
+// Would the live records (oldest .. write_offset, circular) overlap [offset, offset + length)
+static bool overlaps_live(const rewind_t *rewind, uint32_t offset, uint32_t length)
+{
+    const uint32_t oldest = rewind->frames[rewind->first % REWIND_MAX_FRAMES].offset;
+
+    if (oldest < rewind->write_offset)
+        return offset < rewind->write_offset && oldest < offset + length;
+
+    // Live records wrap around the end of the buffer
+    return offset != rewind->write_offset || oldest < offset + length;
+}
+
+// Record one frame of history, no allocation, only the serialized state is copied
+void rewind_push(rewind_t *rewind, const chip8_t *chip8)
+{
+    if (!rewind->buffer)
+        return;
+
+    chip8_save_state(chip8, rewind->scratch, sizeof(rewind->scratch));
+
+    bool key = rewind->next == rewind->first ||
+               rewind->keyframe < rewind->first ||
+               rewind->keyframe >= rewind->next ||
+               rewind->next - rewind->keyframe >= REWIND_KEYFRAME_INTERVAL;
+
+    for (;;)
+    {
+        const uint32_t length = pack_delta(rewind->scratch, key ? NULL : rewind->key_state, rewind->packed);
+
+        // Wrap to start of buffer if record does not fit at the end
+        const uint32_t offset = (rewind->write_offset + length > REWIND_BUFFER_SIZE) ? 0 : rewind->write_offset;
+
+        // Make room by dropping oldest history
+        while (rewind->first < rewind->next &&
+               (rewind->next - rewind->first >= REWIND_MAX_FRAMES || overlaps_live(rewind, offset, length)))
+            drop_oldest(rewind);
+
+        // Delta lost its keyframe while making room, store a keyframe instead
+        if (!key && rewind->keyframe < rewind->first)
+        {
+            key = true;
+            continue;
+        }
+
+        memcpy(&rewind->buffer[offset], rewind->packed, length);
+        rewind->frames[rewind->next % REWIND_MAX_FRAMES] = (rewind_frame_t){
+            .offset = offset,
+            .length = length,
+            .keyframe = key ? rewind->next : rewind->keyframe,
+        };
+        if (key)
+        {
+            rewind->keyframe = rewind->next;
+            memcpy(rewind->key_state, rewind->scratch, sizeof(rewind->key_state));
+        }
+        rewind->next++;
+        rewind->write_offset = offset + length;
+        return;
+    }
+}
+
+// Step back one frame, restoring it into chip8. Returns false once history is used up
+bool rewind_pop(rewind_t *rewind, chip8_t *chip8)
+{
+    if (!rewind->buffer || rewind->first == rewind->next)
+        return false;
+
+    const uint64_t sequence = rewind->next - 1;
+    const rewind_frame_t *frame = &rewind->frames[sequence % REWIND_MAX_FRAMES];
+    const rewind_frame_t *key = &rewind->frames[frame->keyframe % REWIND_MAX_FRAMES];
+
+    memset(rewind->scratch, 0, sizeof(rewind->scratch));
+    unpack_delta(&rewind->buffer[key->offset], key->length, rewind->scratch);
+    if (frame->keyframe != sequence)
+        unpack_delta(&rewind->buffer[frame->offset], frame->length, rewind->scratch);
+
+    // Popped record space is reused by the next push
+    rewind->write_offset = frame->offset;
+    rewind->next = sequence;
+
+    return chip8_load_state(chip8, rewind->scratch, sizeof(rewind->scratch));
+}
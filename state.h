@@ -0,0 +1,56 @@
+#ifndef STATE_H
+#define STATE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "type_defs.h"
+#include "chip8.h"
+
+#define STATE_MAGIC "C8ST"
+#define STATE_VERSION 3
+
+// Serialized machine: header, ram, registers, stack, timers, keypad, FX0A key, random state,
+// resolution, selected planes, display planes
+#define STATE_SIZE (4 + 2 + 4096 + 16 + 2 + 2 + 12 * 2 + 1 + 1 + 1 + NUM_KEYS + 1 + 8 + 1 + 1 + \
+                    DISPLAY_PLANES * DISPLAY_HEIGHT * DISPLAY_ROW_WORDS * 8)
+
+#define REWIND_BUFFER_SIZE (4 * 1024 * 1024)    // Bytes of compressed history
+#define REWIND_MAX_FRAMES (60 * 60 * 60)        // Frames indexed, one hour at 60hz
+#define REWIND_KEYFRAME_INTERVAL 300            // Frames between full snapshots
+
+// Pixel colors and decoded/translated code are not part of a save state
+size_t chip8_save_state(const chip8_t *chip8, uint8_t *buffer, size_t size);
+bool chip8_load_state(chip8_t *chip8, const uint8_t *buffer, size_t size);
+bool chip8_save_state_file(const chip8_t *chip8, const char *path);
+bool chip8_load_state_file(chip8_t *chip8, const char *path);
+
+// One frame of history in the rewind buffer
+struct rewind_frame
+{
+    uint32_t offset;            // Start of compressed record in buffer
+    uint32_t length;            // Compressed bytes
+    uint64_t keyframe;          // Sequence number of the keyframe this delta is XOR'd against
+};
+
+// Rewind history, every frame is an XOR delta against the last keyframe, zero runs compressed
+struct rewind
+{
+    uint8_t *buffer;                    // Compressed records, used as a ring
+    rewind_frame_t *frames;             // Frame records, indexed by sequence % REWIND_MAX_FRAMES
+    uint64_t first;                     // Sequence number of oldest frame kept
+    uint64_t next;                      // Sequence number of next frame pushed
+    uint64_t keyframe;                  // Sequence number of newest keyframe
+    uint32_t write_offset;              // Where the next record goes in buffer
+    uint8_t key_state[STATE_SIZE];      // Uncompressed newest keyframe
+    uint8_t scratch[STATE_SIZE];        // Serialized state being pushed or popped
+    uint8_t packed[STATE_SIZE * 2];     // Compressed record being pushed
+};
+
+bool init_rewind(rewind_t *rewind);
+void destroy_rewind(rewind_t *rewind);
+void rewind_push(rewind_t *rewind, const chip8_t *chip8);
+bool rewind_pop(rewind_t *rewind, chip8_t *chip8);
+
+#endif
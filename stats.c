@@ -0,0 +1,51 @@
+#include <stdio.h>
+
+#include "stats.h"
+
+#ifdef CHIP8_STATS
+bool chip8_stats_write_json(const chip8_stats_t *stats, const char *path)
+{
+    FILE *out = fopen(path, "w");
+    if (!out)
+    {
+        fprintf(stderr, "Could not open stats file %s for writing !\n", path);
+        return false;
+    }
+
+    uint64_t total = 0;
+    for (int c = 0; c < NUM_OPCODE_CLASSES; c++)
+        total += stats->opcode_count[c];
+
+    fprintf(out, "{\n  \"instructions\": %llu,\n  \"opcodes\": {", (unsigned long long)total);
+    bool first = true;
+    for (int c = 0; c < NUM_OPCODE_CLASSES; c++)
+    {
+        if (!stats->opcode_count[c])
+            continue;
+        fprintf(out, "%s\"%s\": %llu", first ? "" : ", ", opcode_class_names[c],
+                (unsigned long long)stats->opcode_count[c]);
+        first = false;
+    }
+
+    // Only addresses that ran, keyed by hex address
+    fprintf(out, "},\n  \"pc\": {");
+    first = true;
+    for (int pc = 0; pc < 4096; pc++)
+    {
+        if (!stats->pc_count[pc])
+            continue;
+        fprintf(out, "%s\"0x%03X\": %llu", first ? "" : ", ", pc, (unsigned long long)stats->pc_count[pc]);
+        first = false;
+    }
+
+    fprintf(out, "},\n  \"dxyn\": {\"draws\": %llu, \"pixels\": %llu, \"collisions\": %llu},\n",
+            (unsigned long long)stats->dxyn_draws, (unsigned long long)stats->dxyn_pixels,
+            (unsigned long long)stats->dxyn_collisions);
+    fprintf(out, "  \"frames\": {\"total\": %llu, \"draw\": %llu, \"late\": %llu, \"dropped\": %llu}\n}\n",
+            (unsigned long long)stats->frames, (unsigned long long)stats->draw_frames,
+            (unsigned long long)stats->late_frames, (unsigned long long)stats->dropped_frames);
+
+    fclose(out);
+    return true;
+}
+#endif
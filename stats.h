@@ -0,0 +1,45 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "type_defs.h"
+#include "chip8.h"
+#include "instruction_tables.h"
+
+// Execution counters, only built with -DCHIP8_STATS=ON. Instructions run natively by
+// the JIT are not counted, profile without --jit
+#ifdef CHIP8_STATS
+struct chip8_stats
+{
+    uint64_t opcode_count[NUM_OPCODE_CLASSES];  // Executions per final handler
+    uint64_t pc_count[4096];                    // Executions per instruction address
+    uint64_t dxyn_draws;                        // DXYN executed
+    uint64_t dxyn_pixels;                       // Sprite pixels XOR'd onto the screen
+    uint64_t dxyn_collisions;                   // DXYN that set VF
+    uint64_t frames;                            // 60hz frames emulated
+    uint64_t draw_frames;                       // Frames with chip8->draw set
+    uint64_t late_frames;                       // Frames that ended past their deadline
+    uint64_t dropped_frames;                    // Whole frame periods lost to late frames
+};
+
+#define STATS_ADD(chip8, field, n) do { if ((chip8)->stats) (chip8)->stats->field += (n); } while (0)
+
+bool chip8_stats_write_json(const chip8_stats_t *stats, const char *path);
+#else
+#define STATS_ADD(chip8, field, n) ((void)sizeof(n)) // No code, still marks n's variables used
+#endif
+
+#define STATS_INC(chip8, field) STATS_ADD(chip8, field, 1)
+
+// Set bits in a display word, portable SWAR count
+static inline uint64_t stats_popcount(uint64_t v)
+{
+    v = v - ((v >> 1) & 0x5555555555555555ull);
+    v = (v & 0x3333333333333333ull) + ((v >> 2) & 0x3333333333333333ull);
+    v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+    return (v * 0x0101010101010101ull) >> 56;
+}
+
+#endif
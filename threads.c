@@ -0,0 +1,85 @@
+#include <string.h>
+
+#include "threads.h"
+
+bool init_command_queue(command_queue_t *queue)
+{
+    memset(queue, 0, sizeof(command_queue_t));
+    queue->wake = SDL_CreateSemaphore(0);
+    if (!queue->wake)
+    {
+        SDL_Log("Could not create command queue semaphore %s\n", SDL_GetError());
+        return false;
+    }
+    return true;
+}
+
+// Render thread side, false when the emulation thread fell COMMAND_QUEUE_SIZE commands behind
+bool command_push(command_queue_t *queue, command_type_t type, int32_t value)
+{
+    return command_push_at(queue, type, value, SDL_GetTicksNS());
+}
+
+// Same, stamped with the time the event happened instead of now
+bool command_push_at(command_queue_t *queue, command_type_t type, int32_t value, uint64_t timestamp)
+{
+    const uint32_t tail = (uint32_t)SDL_GetAtomicInt(&queue->tail);
+    const uint32_t head = (uint32_t)SDL_GetAtomicInt(&queue->head);
+    if (tail - head >= COMMAND_QUEUE_SIZE)
+        return false;
+
+    queue->commands[tail % COMMAND_QUEUE_SIZE] = (command_t){.type = type, .value = value, .timestamp = timestamp};
+
+    // Command visible to the emulation thread before the new tail
+    SDL_SetAtomicInt(&queue->tail, (int)(tail + 1));
+    SDL_SignalSemaphore(queue->wake);
+    return true;
+}
+
+// Emulation thread side, false when the queue is empty
+bool command_pop(command_queue_t *queue, command_t *command)
+{
+    const uint32_t head = (uint32_t)SDL_GetAtomicInt(&queue->head);
+    if (head == (uint32_t)SDL_GetAtomicInt(&queue->tail))
+        return false;
+
+    *command = queue->commands[head % COMMAND_QUEUE_SIZE];
+    SDL_SetAtomicInt(&queue->head, (int)(head + 1));
+    return true;
+}
+
+void destroy_command_queue(command_queue_t *queue)
+{
+    if (queue->wake)
+        SDL_DestroySemaphore(queue->wake);
+}
+
+void init_triple_buffer(triple_buffer_t *buffer)
+{
+    memset(buffer, 0, sizeof(triple_buffer_t));
+    buffer->back = 0;
+    SDL_SetAtomicInt(&buffer->middle, 1);
+    buffer->front = 2;
+}
+
+// Frame the emulation thread fills next, holds whatever it published there last
+render_frame_t *triple_buffer_back(triple_buffer_t *buffer)
+{
+    return &buffer->frames[buffer->back];
+}
+
+// Hand the back frame over, the previous middle becomes the new back
+void triple_buffer_publish(triple_buffer_t *buffer)
+{
+    buffer->back = (uint32_t)SDL_SetAtomicInt(&buffer->middle, (int)(buffer->back | TRIPLE_BUFFER_FRESH)) & 3;
+}
+
+// Newest published frame, NULL if nothing new since the last call
+const render_frame_t *triple_buffer_acquire(triple_buffer_t *buffer)
+{
+    if (!(SDL_GetAtomicInt(&buffer->middle) & TRIPLE_BUFFER_FRESH))
+        return NULL;
+
+    buffer->front = (uint32_t)SDL_SetAtomicInt(&buffer->middle, (int)buffer->front) & 3;
+    return &buffer->frames[buffer->front];
+}
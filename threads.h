@@ -0,0 +1,79 @@
+#ifndef THREADS_H
+#define THREADS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <SDL3/SDL.h>
+
+#include "type_defs.h"
+#include "chip8.h"
+
+#define COMMAND_QUEUE_SIZE 256          // Commands in flight, far more than a frame of key events
+#define TRIPLE_BUFFER_FRESH 4           // Set in middle when the writer published a frame the reader has not taken
+
+// Requests from the render thread, applied by the emulation thread between frames
+enum command_type
+{
+    CMD_QUIT = 0,
+    CMD_KEY_DOWN,                       // value is the CHIP8 key
+    CMD_KEY_UP,
+    CMD_PAUSE,                          // Toggle pause
+    CMD_RESET,
+    CMD_REWIND_START,
+    CMD_REWIND_STOP,
+    CMD_SAVE_STATE,
+    CMD_LOAD_STATE,
+    CMD_WRITE_STATS,
+    CMD_TURBO,                          // Toggle turbo
+    CMD_LERP_RATE,                      // value is +1 or -1 steps of 0.1
+    CMD_VOLUME,                         // value is +1 or -1 steps of 500
+};
+
+struct command
+{
+    command_type_t type;
+    int32_t value;
+    uint64_t timestamp;                 // SDL_GetTicksNS() time of the event, places key events inside a frame
+};
+
+// Single producer single consumer ring, each index only written by its own side
+struct command_queue
+{
+    command_t commands[COMMAND_QUEUE_SIZE];
+    SDL_AtomicInt head;                 // Next command the emulation thread applies
+    SDL_AtomicInt tail;                 // Next slot the render thread fills
+    SDL_Semaphore *wake;                // Signalled per command, the emulation thread sleeps on it when idle
+};
+
+// One published frame, everything the render thread needs without touching chip8_t
+struct render_frame
+{
+    uint32_t pixel_color[DISPLAY_WIDTH * DISPLAY_HEIGHT];
+    uint64_t version;                   // Bumped whenever the pixels changed, texture upload skipped otherwise
+    bool hires;
+    bool turbo;
+    double insts_per_second;            // Measured speed for the title, updated once a second
+};
+
+// Emulation thread writes back, render thread reads front, whole frames are swapped through middle.
+// Neither side ever waits, the reader just sees the newest complete frame
+struct triple_buffer
+{
+    render_frame_t frames[3];
+    SDL_AtomicInt middle;               // Index of the last published frame, plus TRIPLE_BUFFER_FRESH
+    uint32_t back;                      // Emulation thread only
+    uint32_t front;                     // Render thread only
+};
+
+bool init_command_queue(command_queue_t *queue);
+bool command_push(command_queue_t *queue, command_type_t type, int32_t value);
+bool command_push_at(command_queue_t *queue, command_type_t type, int32_t value, uint64_t timestamp);
+bool command_pop(command_queue_t *queue, command_t *command);
+void destroy_command_queue(command_queue_t *queue);
+
+void init_triple_buffer(triple_buffer_t *buffer);
+render_frame_t *triple_buffer_back(triple_buffer_t *buffer);
+void triple_buffer_publish(triple_buffer_t *buffer);
+const render_frame_t *triple_buffer_acquire(triple_buffer_t *buffer);
+
+#endif
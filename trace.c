@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app.h"
+#include "exec_trace.h"
+#include "instruction_tables.h"
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [--last N] [--before ADDR] [--histogram] <trace file>\n", program);
+}
+
+// Registers the instruction changed, VX then VF
+static void print_delta(const trace_record_t *record)
+{
+    const uint8_t X = (record->opcode >> 8) & 0x0F;
+    if (record->vx_after != record->vx && X != 0xF)
+        printf(" [V%X 0x%02X -> 0x%02X]", X, record->vx, record->vx_after);
+    if (record->vf_after != record->vf)
+        printf(" [VF 0x%02X -> 0x%02X]", record->vf, record->vf_after);
+}
+
+static void print_histogram(const trace_t *trace, uint64_t first, uint64_t end)
+{
+    uint64_t counts[NUM_OPCODE_CLASSES] = {0};
+    uint64_t blocks = 0, block_insts = 0;
+    const handler_table_t *handlers = &handler_tables[trace->extension];
+    for (uint64_t n = first; n < end; n++)
+    {
+        const trace_record_t *record = trace_get(trace, n);
+        if (record->flags & TRACE_BLOCK)
+        {
+            blocks++;
+            block_insts += record->aux;
+        }
+        else
+            counts[opcode_class(decode_opcode(handlers, record->opcode), record->opcode)]++;
+    }
+
+    const uint64_t total = end - first - blocks;
+    printf("%-8s %14s %8s\n", "class", "count", "%");
+    for (int c = 0; c < NUM_OPCODE_CLASSES; c++)
+    {
+        if (counts[c])
+            printf("%-8s %14llu %8.2f\n", opcode_class_names[c], (unsigned long long)counts[c],
+                   100.0 * (double)counts[c] / (double)total);
+    }
+
+    // Blocks only keep their first instruction, so their contents can't be classified
+    if (blocks)
+        printf("%-8s %14llu (%llu instructions)\n", "jit", (unsigned long long)blocks, (unsigned long long)block_insts);
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = NULL;
+    uint64_t last = 0;
+    long before = -1;
+    bool histogram = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--last") == 0 && i + 1 < argc)
+            last = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--before") == 0 && i + 1 < argc)
+            before = strtol(argv[++i], NULL, 0) & 0xFFF;
+        else if (strcmp(argv[i], "--histogram") == 0)
+            histogram = true;
+        else if (argv[i][0] == '-' || path)
+        {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        else
+            path = argv[i];
+    }
+
+    if (!path)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    trace_t trace;
+    if (!trace_open(&trace, path))
+        return EXIT_FAILURE;
+
+    // Window of records: ends at the newest one, or at the newest one at --before's address
+    uint64_t first = trace_first(&trace);
+    uint64_t end = trace.head;
+    if (before >= 0)
+    {
+        while (end > first && trace_get(&trace, end - 1)->pc != before)
+            end--;
+        if (end == first)
+        {
+            fprintf(stderr, "PC never reached 0x%03lX in the last %llu records\n", before,
+                    (unsigned long long)(trace.head - first));
+            trace_close(&trace);
+            return EXIT_FAILURE;
+        }
+    }
+    if (last && end - first > last)
+        first = end - last;
+
+    if (histogram)
+        print_histogram(&trace, first, end);
+    else
+    {
+        char text[256];
+        for (uint64_t n = first; n < end; n++)
+        {
+            const trace_record_t *record = trace_get(&trace, n);
+            trace_describe(record, n + 1 < trace.head ? trace_get(&trace, n + 1) : NULL, text, sizeof(text));
+            printf("%10llu %s", (unsigned long long)n, text);
+            print_delta(record);
+            printf("\n");
+        }
+    }
+
+    trace_close(&trace);
+    return EXIT_SUCCESS;
+}
@@ -3,8 +3,39 @@
 
 typedef struct sdl sdl_t;
 typedef struct instruction instruction_t;
+typedef struct decoded_instruction decoded_instruction_t;
+typedef struct handler_table handler_table_t;
 typedef struct chip8 chip8_t;
+typedef struct breakpoints breakpoints_t;
 typedef struct config config_t;
+typedef struct jit jit_t;
+typedef struct jit_block jit_block_t;
+typedef struct fade fade_t;
+typedef struct rewind rewind_t;
+typedef struct rewind_frame rewind_frame_t;
+typedef struct frame_clock frame_clock_t;
+typedef struct chip8_stats chip8_stats_t;
+typedef struct rom_profile rom_profile_t;
+typedef struct rom_index_entry rom_index_entry_t;
+typedef struct rom_index rom_index_t;
+typedef struct trace trace_t;
+typedef struct trace_record trace_record_t;
+typedef struct aot_block aot_block_t;
+typedef struct verifier verifier_t;
+typedef struct verify_snapshot verify_snapshot_t;
+typedef struct capture capture_t;
+typedef struct gdb gdb_t;
+typedef struct capture_frame capture_frame_t;
+typedef struct command command_t;
+typedef struct command_queue command_queue_t;
+typedef struct render_frame render_frame_t;
+typedef struct triple_buffer triple_buffer_t;
+typedef struct platform_thread platform_thread_t;
+typedef struct platform_mutex platform_mutex_t;
 typedef enum emulator_state emulator_state_t;
 typedef enum extension extension_t;
+typedef enum opcode_class opcode_class_t;
+typedef enum capture_format capture_format_t;
+typedef enum gdb_parse gdb_parse_t;
+typedef enum command_type command_type_t;
 #endif
\ No newline at end of file
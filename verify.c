@@ -0,0 +1,316 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "verify.h"
+
+#define VERIFY_DUMP_RAM_LINES 32    // Differing ram bytes listed before giving up
+
+static uint64_t mix(uint64_t hash, uint64_t value)
+{
+    return (hash ^ value) * 0x100000001B3ull;
+}
+
+// Hash of everything an instruction can change: registers, stack, timers, ram, display, random state.
+// xor and multiply by an odd constant are both invertible, so a single differing word always shows
+uint64_t verify_hash(const chip8_t *chip8)
+{
+    uint64_t hash = 0xCBF29CE484222325ull;
+    uint64_t word;
+
+    for (size_t i = 0; i < sizeof(chip8->ram); i += 8)
+    {
+        memcpy(&word, &chip8->ram[i], 8);
+        hash = mix(hash, word);
+    }
+    for (size_t i = 0; i < DISPLAY_PLANES * DISPLAY_HEIGHT * DISPLAY_ROW_WORDS; i++)
+        hash = mix(hash, chip8_framebuffer(chip8)[i]);
+
+    memcpy(&word, &chip8->V[0], 8);
+    hash = mix(hash, word);
+    memcpy(&word, &chip8->V[8], 8);
+    hash = mix(hash, word);
+    for (int i = 0; i < 12; i++)
+        hash = mix(hash, chip8->stack[i]);
+
+    hash = mix(hash, (uint64_t)(chip8->stack_ptr - chip8->stack) << 48 | (uint64_t)chip8->I << 32 |
+                     (uint64_t)chip8->PC << 16 | chip8->delay_timer << 8 | chip8->sound_timer);
+    hash = mix(hash, (uint64_t)chip8->hires << 16 | (uint64_t)chip8->planes << 8 | chip8->wait_key);
+    return mix(hash, chip8->rng);
+}
+
+// Struct copy with the stack pointer moved over to the copy's stack
+static void copy_machine(chip8_t *to, const chip8_t *from)
+{
+    *to = *from;
+    to->stack_ptr = &to->stack[from->stack_ptr - from->stack];
+}
+
+static void save_snapshot(const verifier_t *verifier, verify_snapshot_t *snapshot)
+{
+    copy_machine(&snapshot->fast, &verifier->fast);
+    copy_machine(&snapshot->reference, &verifier->reference);
+    if (verifier->jit)
+        snapshot->jit = *verifier->jit;
+    snapshot->frame = verifier->frame;
+    snapshot->insts = verifier->insts;
+    snapshot->remainder = verifier->remainder;
+}
+
+static void restore_snapshot(verifier_t *verifier, const verify_snapshot_t *snapshot)
+{
+    copy_machine(&verifier->fast, &snapshot->fast);
+    copy_machine(&verifier->reference, &snapshot->reference);
+    if (verifier->jit)
+    {
+        // Code buffer was reused since, the snapshot's blocks can't be trusted
+        const uint32_t generation = verifier->jit->generation;
+        *verifier->jit = snapshot->jit;
+        if (generation != snapshot->jit.generation)
+            jit_flush(verifier->jit);
+    }
+    verifier->frame = snapshot->frame;
+    verifier->insts = snapshot->insts;
+    verifier->remainder = snapshot->remainder;
+}
+
+// Scripted input both machines see, one pseudo random key held down for a few frames every period
+static void set_keys(verifier_t *verifier)
+{
+    const uint64_t period = verifier->frame / VERIFY_KEY_PERIOD;
+    const bool down = verifier->frame % VERIFY_KEY_PERIOD < VERIFY_KEY_HOLD;
+    const uint8_t key = (uint8_t)(((period + verifier->config.seed) * 0x9E3779B97F4A7C15ull) >> 60);
+
+    for (uint8_t k = 0; k < NUM_KEYS; k++)
+    {
+        chip8_set_key(&verifier->fast, k, down && k == key);
+        chip8_set_key(&verifier->reference, k, down && k == key);
+    }
+}
+
+// Engine under test for up to num_insts, stops early when the rom idles like it does in the frontend
+static uint32_t run_fast(verifier_t *verifier, uint32_t num_insts)
+{
+    if (verifier->jit)
+        return jit_run(verifier->jit, &verifier->fast, &verifier->config, num_insts);
+    return chip8_step(&verifier->fast, &verifier->config, num_insts);
+}
+
+// Instructions the next frame gets, same fractional split per 60hz frame as the frontend
+static uint32_t frame_insts(verifier_t *verifier)
+{
+    const uint32_t total = verifier->config.insts_per_second + verifier->remainder;
+    uint32_t n = total / 60;
+    verifier->remainder = total % 60;
+    if (verifier->max_insts && verifier->insts + n > verifier->max_insts)
+        n = (uint32_t)(verifier->max_insts - verifier->insts);
+    return n;
+}
+
+// One frame, the reference runs exactly as many instructions as the engine did. Timers not ticked yet
+static uint32_t run_frame(verifier_t *verifier)
+{
+    const uint32_t n = frame_insts(verifier);
+    set_keys(verifier);
+
+    const uint32_t done = run_fast(verifier, n);
+    for (uint32_t i = 0; i < done; i++)
+        emulate_instruction_reference(&verifier->reference, &verifier->config);
+    verifier->insts += done;
+    return done;
+}
+
+static void end_frame(verifier_t *verifier)
+{
+    chip8_tick_timers(&verifier->fast);
+    chip8_tick_timers(&verifier->reference);
+    verifier->frame++;
+}
+
+static bool states_match(const verifier_t *verifier)
+{
+    return verify_hash(&verifier->fast) == verify_hash(&verifier->reference);
+}
+
+// Engine under test for exactly one dispatch, a single instruction or a whole translated block
+static uint32_t step_fast(verifier_t *verifier, uint32_t num_insts)
+{
+    if (verifier->jit)
+        return jit_step(verifier->jit, &verifier->fast, &verifier->config, num_insts);
+    emulate_instruction(&verifier->fast, &verifier->config);
+    return 1;
+}
+
+// Replay from the last matching compare a frame at a time to the first frame that diverges,
+// then step that frame one engine dispatch at a time to the first one whose result differs
+static void find_divergence(verifier_t *verifier, uint64_t end_frame_number)
+{
+    restore_snapshot(verifier, &verifier->last_match);
+
+    uint32_t frame_length = 0;
+    bool found = false;
+    while (verifier->frame < end_frame_number)
+    {
+        save_snapshot(verifier, &verifier->frame_start);
+        frame_length = run_frame(verifier);
+        if (!states_match(verifier))
+        {
+            found = true;
+            break;
+        }
+        end_frame(verifier);
+    }
+
+    // Engine took a different path the second time, e.g. the JIT translated other blocks
+    if (!found)
+        return;
+
+    // Same budget per dispatch as the run_frame above, so the JIT runs the same blocks
+    restore_snapshot(verifier, &verifier->frame_start);
+    const uint32_t budget = frame_insts(verifier);
+    set_keys(verifier);
+
+    for (uint32_t done = 0; done < frame_length; )
+    {
+        const uint16_t pc = verifier->fast.PC & 0xFFF;
+        const uint32_t n = step_fast(verifier, budget - done);
+        for (uint32_t i = 0; i < n; i++)
+            emulate_instruction_reference(&verifier->reference, &verifier->config);
+        done += n;
+
+        if (states_match(verifier))
+            continue;
+
+        // Machines are left in the first diverged state for verify_dump
+        verifier->insts += done;
+        verifier->diverged_frame = verifier->frame;
+        verifier->diverged_inst = verifier->insts;
+        verifier->diverged_pc = pc;
+        verifier->diverged_opcode = (uint16_t)(verifier->reference.ram[pc] << 8 | verifier->reference.ram[(pc + 1) & 0xFFF]);
+        const jit_block_t *block = verifier->jit ? &verifier->jit->blocks[pc] : NULL;
+        verifier->diverged_block_length = block && block->code && block->num_insts == n ? block->length : 0;
+        verifier->reproduced = true;
+        return;
+    }
+}
+
+bool init_verifier(verifier_t *verifier, jit_t *jit, uint64_t interval)
+{
+    memset(verifier, 0, sizeof(verifier_t));
+    verifier->jit = jit;
+    verifier->interval = interval ? interval : VERIFY_DEFAULT_INTERVAL;
+    return true;
+}
+
+// Run rom on both machines, comparing state hashes every interval instructions and at the end.
+// False on a mismatch, with the divergence fields filled out
+bool verify_rom(verifier_t *verifier, const config_t *config, const uint8_t *rom, size_t rom_size,
+                uint64_t frames, uint64_t max_insts)
+{
+    verifier->config = *config;
+    verifier->max_insts = max_insts;
+    verifier->frame = 0;
+    verifier->insts = 0;
+    verifier->remainder = 0;
+    verifier->checks = 0;
+    verifier->diverged = false;
+    verifier->reproduced = false;
+    verifier->diverged_block_length = 0;
+
+    if (!chip8_load_rom(&verifier->fast, config, rom, rom_size) ||
+        !chip8_load_rom(&verifier->reference, config, rom, rom_size))
+        return false;
+    if (verifier->jit)
+        jit_flush(verifier->jit);
+    save_snapshot(verifier, &verifier->last_match);
+
+    uint64_t since_check = 0;
+    while ((!frames || verifier->frame < frames) && (!max_insts || verifier->insts < max_insts))
+    {
+        since_check += run_frame(verifier);
+        end_frame(verifier);
+
+        const bool last = (frames && verifier->frame >= frames) || (max_insts && verifier->insts >= max_insts);
+        if (since_check < verifier->interval && !last)
+            continue;
+
+        verifier->checks++;
+        since_check = 0;
+        if (!states_match(verifier))
+        {
+            verifier->diverged = true;
+            verifier->diverged_frame = verifier->frame;
+            verifier->diverged_inst = verifier->insts;
+            find_divergence(verifier, verifier->frame);
+            return false;
+        }
+        save_snapshot(verifier, &verifier->last_match);
+    }
+
+    return true;
+}
+
+static void dump_row(FILE *out, const char *name, uint32_t fast, uint32_t reference, int digits)
+{
+    fprintf(out, "  %-10s %0*X %*s%0*X%s\n", name, digits, fast, 8 - digits, "", digits, reference,
+            fast != reference ? "  *" : "");
+}
+
+// Both machines side by side, differences marked with *
+void verify_dump(FILE *out, const chip8_t *fast, const chip8_t *reference)
+{
+    char name[32];
+
+    fprintf(out, "  %-10s %-8s %s\n", "", "engine", "reference");
+    dump_row(out, "PC", fast->PC, reference->PC, 4);
+    dump_row(out, "I", fast->I, reference->I, 4);
+    for (int i = 0; i < 16; i++)
+    {
+        snprintf(name, sizeof(name), "V%X", i);
+        dump_row(out, name, fast->V[i], reference->V[i], 2);
+    }
+    dump_row(out, "SP", (uint32_t)(fast->stack_ptr - fast->stack), (uint32_t)(reference->stack_ptr - reference->stack), 2);
+    for (int i = 0; i < 12; i++)
+    {
+        if (fast->stack[i] || reference->stack[i])
+        {
+            snprintf(name, sizeof(name), "stack[%d]", i);
+            dump_row(out, name, fast->stack[i], reference->stack[i], 4);
+        }
+    }
+    dump_row(out, "DT", fast->delay_timer, reference->delay_timer, 2);
+    dump_row(out, "ST", fast->sound_timer, reference->sound_timer, 2);
+    dump_row(out, "hires", fast->hires, reference->hires, 2);
+    dump_row(out, "planes", fast->planes, reference->planes, 2);
+    dump_row(out, "wait key", fast->wait_key, reference->wait_key, 2);
+    if (fast->rng != reference->rng)
+        fprintf(out, "  %-10s %016llX %016llX  *\n", "rng", (unsigned long long)fast->rng,
+                (unsigned long long)reference->rng);
+
+    int lines = 0;
+    for (uint32_t i = 0; i < sizeof(fast->ram); i++)
+    {
+        if (fast->ram[i] == reference->ram[i])
+            continue;
+        if (lines++ == VERIFY_DUMP_RAM_LINES)
+        {
+            fprintf(out, "  ... more ram differs\n");
+            break;
+        }
+        snprintf(name, sizeof(name), "ram[%03X]", i);
+        dump_row(out, name, fast->ram[i], reference->ram[i], 2);
+    }
+
+    for (int plane = 0; plane < DISPLAY_PLANES; plane++)
+    {
+        for (int y = 0; y < DISPLAY_HEIGHT; y++)
+        {
+            if (memcmp(fast->display[plane][y], reference->display[plane][y], sizeof(fast->display[plane][y])) == 0)
+                continue;
+            fprintf(out, "  plane %d row %2d\n", plane, y);
+            for (int w = 0; w < DISPLAY_ROW_WORDS; w++)
+                fprintf(out, "    %016llX %016llX\n", (unsigned long long)fast->display[plane][y][w],
+                        (unsigned long long)reference->display[plane][y][w]);
+        }
+    }
+}
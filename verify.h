@@ -0,0 +1,60 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "type_defs.h"
+#include "app.h"
+#include "chip8.h"
+#include "jit.h"
+
+#define VERIFY_DEFAULT_INTERVAL 1000    // Instructions between state hash compares, rounded up to whole frames
+#define VERIFY_KEY_PERIOD 20            // Frames between scripted key presses
+#define VERIFY_KEY_HOLD 8               // Frames each scripted key stays down
+
+// Both machines at a point their states matched, replayed when looking for the diverging instruction
+struct verify_snapshot
+{
+    chip8_t fast;
+    chip8_t reference;
+    jit_t jit;                  // Translated blocks, so the replay runs the same native code
+    uint64_t frame;
+    uint64_t insts;
+    uint32_t remainder;
+};
+
+// Runs the engine under test and the plain reference interpreter in lockstep on the same rom and input
+struct verifier
+{
+    chip8_t fast;               // Machine run by the cached interpreter or the JIT
+    chip8_t reference;          // Machine run by emulate_instruction_reference
+    jit_t *jit;                 // Engine under test, NULL for the cached interpreter
+    config_t config;
+    uint64_t interval;          // Instructions between compares
+    uint64_t max_insts;         // Instructions to run, 0 for no limit
+    uint64_t frame;             // Frames run so far
+    uint64_t insts;             // Instructions run so far, same on both machines
+    uint32_t remainder;         // Instructions carried over to the next frame, in 1/60ths
+    uint64_t checks;            // State compares done
+    verify_snapshot_t last_match;   // Last compare that matched
+    verify_snapshot_t frame_start;  // Start of the frame being bisected
+
+    // Filled out when the machines diverge, fast and reference are left in the diverged states
+    bool diverged;
+    bool reproduced;            // Replay from last_match diverged again, the fields below are exact
+    uint64_t diverged_frame;
+    uint64_t diverged_inst;     // Instructions run up to and including the one that diverged
+    uint16_t diverged_pc;       // Address of that instruction, or of the translated block it ran in
+    uint16_t diverged_opcode;
+    uint16_t diverged_block_length; // Bytes of ram that block covers, 0 if the instruction was interpreted
+};
+
+bool init_verifier(verifier_t *verifier, jit_t *jit, uint64_t interval);
+bool verify_rom(verifier_t *verifier, const config_t *config, const uint8_t *rom, size_t rom_size,
+                uint64_t frames, uint64_t max_insts);
+uint64_t verify_hash(const chip8_t *chip8);
+void verify_dump(FILE *out, const chip8_t *fast, const chip8_t *reference);
+
+#endif